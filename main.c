@@ -7,11 +7,18 @@
 #include <dirent.h>
 #include <strings.h>
 #include <math.h>
+#include <time.h>
 #ifdef _WIN32
 #include <direct.h>
 #define getcwd _getcwd
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 
 #include "stb_image.h"
@@ -26,106 +33,315 @@ extern unsigned char *stbi_write_png_to_mem(const unsigned char *pixels, int str
 
 #define ARRAY_COUNT(x) (sizeof(x)/sizeof((x)[0]))
 #define MAX_ASSETS 256
-#define MAX_TOKENS 256
-#define MAX_DRAWINGS 256
-#define SAVE_MAGIC 0x56545402  // Version 2 with embedded assets
+#define SAVE_MAGIC 0x56545405  // Version 5: chunks listed in a table of contents, see save_slot
+#define SAVE_MAGIC_V4 0x56545404  // Version 4: each asset once, as its original file bytes
+#define SAVE_MAGIC_V3 0x56545403  // Version 3: packed fog bits
+#define SAVE_MAGIC_V2 0x56545402  // Version 2 with embedded assets, one byte per fog cell
 
 // Profiling system (set to 0 to disable)
 #define PROFILER_ENABLED 1
-#define MAX_PROFILE_ENTRIES 32
+#define PROFILE_HISTORY 240     // Frames of history kept per zone
+#define PROFILE_MAX_DEPTH 16    // Nesting depth tracked per thread
+#define PROFILE_THREADS 2       // Main thread, player render thread
+#define PROFILE_TRACE_EVENTS 65536  // Spans kept while tracing; the oldest are overwritten
+
+// Zone IDs are resolved at compile time: PROFILE_BEGIN(name) needs an X(name) entry here
+#define PROFILE_ZONES(X) \
+    X(handle_input) X(cam_update) X(player_capture) X(render_dm) X(render_player) \
+    X(clear_screen) X(map_render) X(grid_render) X(drawings_render) X(token_cull) X(token_auras_render) \
+    X(tokens_render) X(fog_render) X(fog_soft_update) X(token_markers_render) \
+    X(calibration_render) X(measurement_render) X(fog_brush_preview) X(ui_render) X(present) \
+    X(autosave) X(input_to_present)
+
+// Per-frame counts, summed per thread: PROFILE_COUNT(name, n) needs an X(name) entry here
+#define PROFILE_COUNTERS(X) \
+    X(tokens_drawn) X(tokens_culled) X(auras_drawn) X(auras_culled) \
+    X(markers_drawn) X(markers_culled) X(drawings_drawn) X(drawings_culled)
+
+typedef enum {
+#define PROFILE_ZONE_ENUM(name) PZ_##name,
+    PROFILE_ZONES(PROFILE_ZONE_ENUM)
+    PZ_COUNT
+} ProfileZone;
+#define PZ_NONE (-1)
+
+static const char *profile_zone_names[PZ_COUNT] = {
+#define PROFILE_ZONE_NAME(name) #name,
+    PROFILE_ZONES(PROFILE_ZONE_NAME)
+};
+
+typedef enum {
+#define PROFILE_COUNTER_ENUM(name) PC_##name,
+    PROFILE_COUNTERS(PROFILE_COUNTER_ENUM)
+    PC_COUNT
+} ProfileCounter;
+
+static const char *profile_counter_names[PC_COUNT] = {
+    PROFILE_COUNTERS(PROFILE_ZONE_NAME)
+};
+
+typedef struct {
+    uint64_t total, self;  // Ticks this frame, with and without nested zones
+    uint32_t hit_count;
+} ProfileAccum;
 
 typedef struct {
-    const char *name;
-    uint64_t elapsed;
+    uint64_t value;
     uint32_t hit_count;
-} ProfileEntry;
+} ProfileCount;
+
+typedef struct {
+    int zone;
+    uint64_t start, child;  // Entry time, ticks spent in nested zones so far
+} ProfileOpen;
+
+// One span for the Chrome trace-event export
+typedef struct {
+    uint64_t start, dur;  // Ticks
+    SDL_ThreadID tid;
+    int zone;
+} TraceEvent;
+
+typedef struct {
+    float p50, p95, p99, max;
+    int n;  // Frames in the history where the zone ran
+} ProfileStats;
 
 static struct {
-    ProfileEntry entries[MAX_PROFILE_ENTRIES];
-    int count;
+    ProfileAccum cur[PROFILE_THREADS][PZ_COUNT];  // Current frame, per thread
+    float total_ms[PROFILE_THREADS][PZ_COUNT][PROFILE_HISTORY];  // < 0 when the zone did not run that frame
+    float self_ms[PROFILE_THREADS][PZ_COUNT][PROFILE_HISTORY];
+    int parent[PROFILE_THREADS][PZ_COUNT];  // Enclosing zone when last entered, PZ_NONE at top level
+    ProfileCount count_cur[PROFILE_THREADS][PC_COUNT];
+    float count[PROFILE_THREADS][PC_COUNT][PROFILE_HISTORY];  // < 0 when nothing was counted that frame
+    float frame_ms[PROFILE_HISTORY];
+    int head, frames;   // Next history slot, frames recorded so far (up to PROFILE_HISTORY)
     uint64_t freq;
     uint64_t frame_start;
+    float budget_ms;    // Frame period of the DM display
     bool show_overlay;
+    SDL_Mutex *lock;    // Zones are recorded from the main and player render threads
+    SDL_ThreadID thread_ids[PROFILE_THREADS];
+    bool tracing;
+    TraceEvent *trace;  // Ring of PROFILE_TRACE_EVENTS, allocated when tracing first starts
+    int trace_head, trace_count;
+    uint64_t trace_origin;
 } profiler;
 
+// Open zones of the calling thread; each thread sets profile_thread when it starts
+static _Thread_local ProfileOpen profile_stack[PROFILE_MAX_DEPTH];
+static _Thread_local int profile_depth;
+static _Thread_local int profile_thread;
+
 #if PROFILER_ENABLED
-#define PROFILE_BEGIN(name) uint64_t _prof_start_##name = SDL_GetPerformanceCounter()
-#define PROFILE_END(name) profile_record(#name, _prof_start_##name, SDL_GetPerformanceCounter())
+#define PROFILE_BEGIN(name) profile_begin(PZ_##name)
+#define PROFILE_END(name) profile_end(PZ_##name)
+#define PROFILE_COUNT(name, n) profile_count(PC_##name, (n))
 #else
 #define PROFILE_BEGIN(name)
 #define PROFILE_END(name)
+#define PROFILE_COUNT(name, n)
 #endif
 
-static void profile_record(const char *name, uint64_t start, uint64_t end) {
-    uint64_t elapsed = end - start;
-    
-    // Find or create entry
-    ProfileEntry *entry = NULL;
-    for (int i = 0; i < profiler.count; i++) {
-        if (strcmp(profiler.entries[i].name, name) == 0) {
-            entry = &profiler.entries[i];
-            break;
-        }
+static void profile_add(int zone, uint64_t start, uint64_t total, uint64_t self, int parent) {
+    SDL_LockMutex(profiler.lock);
+    ProfileAccum *a = &profiler.cur[profile_thread][zone];
+    a->total += total;
+    a->self += self;
+    a->hit_count++;
+    profiler.parent[profile_thread][zone] = parent;
+    if (profiler.tracing) {
+        profiler.trace[profiler.trace_head] = (TraceEvent){start, total, profiler.thread_ids[profile_thread], zone};
+        profiler.trace_head = (profiler.trace_head + 1) % PROFILE_TRACE_EVENTS;
+        if (profiler.trace_count < PROFILE_TRACE_EVENTS) profiler.trace_count++;
     }
-    
-    if (!entry && profiler.count < MAX_PROFILE_ENTRIES) {
-        entry = &profiler.entries[profiler.count++];
-        entry->name = name;
-        entry->elapsed = 0;
-        entry->hit_count = 0;
+    SDL_UnlockMutex(profiler.lock);
+}
+
+static void profile_begin(int zone) {
+    if (profile_depth < PROFILE_MAX_DEPTH)
+        profile_stack[profile_depth] = (ProfileOpen){zone, SDL_GetPerformanceCounter(), 0};
+    profile_depth++;
+}
+
+// Zones must nest: each end closes the most recently begun zone on this thread
+static void profile_end(int zone) {
+    uint64_t now = SDL_GetPerformanceCounter();
+    if (--profile_depth >= PROFILE_MAX_DEPTH) return;  // Deeper than tracked
+    ProfileOpen *o = &profile_stack[profile_depth];
+    uint64_t elapsed = now - o->start;
+    int parent = PZ_NONE;
+    if (profile_depth > 0) {
+        profile_stack[profile_depth - 1].child += elapsed;
+        parent = profile_stack[profile_depth - 1].zone;
     }
+    profile_add(zone, o->start, elapsed, elapsed - o->child, parent);
+}
+
+static void profile_count(int counter, uint64_t n) {
+    SDL_LockMutex(profiler.lock);
+    ProfileCount *c = &profiler.count_cur[profile_thread][counter];
+    c->value += n;
+    c->hit_count++;
+    SDL_UnlockMutex(profiler.lock);
+}
+
+// Records a span measured in nanoseconds (e.g. from SDL event timestamps)
+static void profile_record_ns(int zone, uint64_t ns) {
+    uint64_t ticks = (uint64_t)((double)ns * profiler.freq / 1e9);
+    profile_add(zone, SDL_GetPerformanceCounter() - ticks, ticks, ticks, PZ_NONE);
+}
+
+static void profile_trace_start(void) {
+    if (!profiler.trace) profiler.trace = malloc(PROFILE_TRACE_EVENTS * sizeof(TraceEvent));
+    if (!profiler.trace) return;
+    SDL_LockMutex(profiler.lock);
+    profiler.trace_head = profiler.trace_count = 0;
+    profiler.trace_origin = SDL_GetPerformanceCounter();
+    profiler.tracing = true;
+    SDL_UnlockMutex(profiler.lock);
+    printf("Trace recording started\n");
+}
+
+// Stops recording and writes the ring as Chrome trace-event JSON (chrome://tracing, Perfetto)
+static void profile_trace_stop(void) {
+    SDL_LockMutex(profiler.lock);
+    profiler.tracing = false;  // Nothing writes the ring after this
+    SDL_UnlockMutex(profiler.lock);
     
-    if (entry) {
-        entry->elapsed += elapsed;
-        entry->hit_count++;
+    char path[64];
+    time_t now = time(NULL);
+    strftime(path, sizeof(path), "trace_%Y%m%d_%H%M%S.json", localtime(&now));
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        printf("Could not write %s\n", path);
+        return;
+    }
+    static const char *thread_names[PROFILE_THREADS] = {"main", "player render"};
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (int t = 0; t < PROFILE_THREADS; t++)
+        fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%llu,\"args\":{\"name\":\"%s\"}},\n",
+                (unsigned long long)profiler.thread_ids[t], thread_names[t]);
+    double to_us = 1e6 / profiler.freq;
+    int first = (profiler.trace_head - profiler.trace_count + PROFILE_TRACE_EVENTS) % PROFILE_TRACE_EVENTS;
+    for (int i = 0; i < profiler.trace_count; i++) {
+        const TraceEvent *e = &profiler.trace[(first + i) % PROFILE_TRACE_EVENTS];
+        fprintf(f, "{\"name\":\"%s\",\"cat\":\"vtt\",\"ph\":\"X\",\"pid\":1,\"tid\":%llu,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+                profile_zone_names[e->zone], (unsigned long long)e->tid,
+                (double)(int64_t)(e->start - profiler.trace_origin) * to_us, e->dur * to_us,
+                i + 1 < profiler.trace_count ? "," : "");
+    }
+    fprintf(f, "]}\n");
+    fclose(f);
+    printf("Trace written to %s (%d spans)\n", path, profiler.trace_count);
+}
+
+static int profile_cmp_float(const void *a, const void *b) {
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentiles over the frames in the history where the zone ran; caller holds the lock
+static ProfileStats profile_stats(const float *ring) {
+    float v[PROFILE_HISTORY];
+    int n = 0;
+    for (int i = 0; i < profiler.frames; i++)
+        if (ring[i] >= 0) v[n++] = ring[i];
+    ProfileStats s = {0};
+    s.n = n;
+    if (n == 0) return s;
+    qsort(v, n, sizeof(float), profile_cmp_float);
+    s.p50 = v[(n * 50 + 99) / 100 - 1];
+    s.p95 = v[(n * 95 + 99) / 100 - 1];
+    s.p99 = v[(n * 99 + 99) / 100 - 1];
+    s.max = v[n - 1];
+    return s;
+}
+
+// Zones of one thread in tree order (children follow their parent); returns the new row count
+static int profile_zone_rows(int t, int parent, int depth, int (*rows)[2], int n) {
+    if (depth >= PROFILE_MAX_DEPTH) return n;
+    for (int z = 0; z < PZ_COUNT; z++) {
+        if (profiler.parent[t][z] != parent || n >= PROFILE_THREADS * PZ_COUNT) continue;
+        rows[n][0] = z;
+        rows[n][1] = depth;
+        n = profile_zone_rows(t, z, depth + 1, rows, n + 1);
     }
+    return n;
 }
 
 static void profile_frame_begin() {
     profiler.frame_start = SDL_GetPerformanceCounter();
-    // Reset counters
-    for (int i = 0; i < profiler.count; i++) {
-        profiler.entries[i].elapsed = 0;
-        profiler.entries[i].hit_count = 0;
-    }
 }
 
+// Moves this frame's totals into the history; prints percentiles every 60 frames while enabled
 static void profile_frame_end() {
     uint64_t frame_end = SDL_GetPerformanceCounter();
-    uint64_t frame_time = frame_end - profiler.frame_start;
+    float to_ms = 1000.0f / profiler.freq;
+    
+    SDL_LockMutex(profiler.lock);
+    int h = profiler.head;
+    profiler.frame_ms[h] = (frame_end - profiler.frame_start) * to_ms;
+    for (int t = 0; t < PROFILE_THREADS; t++) {
+        for (int z = 0; z < PZ_COUNT; z++) {
+            ProfileAccum *a = &profiler.cur[t][z];
+            profiler.total_ms[t][z][h] = a->hit_count ? a->total * to_ms : -1.0f;
+            profiler.self_ms[t][z][h] = a->hit_count ? a->self * to_ms : -1.0f;
+            *a = (ProfileAccum){0};
+        }
+        for (int k = 0; k < PC_COUNT; k++) {
+            ProfileCount *c = &profiler.count_cur[t][k];
+            profiler.count[t][k][h] = c->hit_count ? (float)c->value : -1.0f;
+            *c = (ProfileCount){0};
+        }
+    }
+    profiler.head = (h + 1) % PROFILE_HISTORY;
+    if (profiler.frames < PROFILE_HISTORY) profiler.frames++;
+    SDL_UnlockMutex(profiler.lock);
     
     if (!profiler.show_overlay) return;
     
     // Print to console every 60 frames
     static int frame_counter = 0;
     if (++frame_counter >= 60) {
+        SDL_LockMutex(profiler.lock);
         frame_counter = 0;
         
-        float frame_ms = (frame_time * 1000.0f) / profiler.freq;
-        float budget_ms = 16.67f; // 60 FPS target
-        
-        printf("\n=== PROFILER (Frame: %.2f ms / %.2f ms budget) ===\n", frame_ms, budget_ms);
-        printf("%-30s %10s %8s %8s %6s\n", "Function", "Time(ms)", "Calls", "Avg(us)", "%");
-        printf("----------------------------------------------------------------\n");
+        ProfileStats fs = profile_stats(profiler.frame_ms);
+        printf("\n=== PROFILER (last %d frames, %.2f ms budget) ===\n", profiler.frames, profiler.budget_ms);
+        printf("%-30s %8s %8s %8s %8s\n", "Frame", "p50", "p95", "p99", "max");
+        printf("%-30s %8.2f %8.2f %8.2f %8.2f\n", "", fs.p50, fs.p95, fs.p99, fs.max);
+        printf("%-30s %8s %8s %8s %8s %8s\n", "Zone (ms)", "p50", "p95", "p99", "max", "self p50");
+        printf("------------------------------------------------------------------------------\n");
         
-        for (int i = 0; i < profiler.count; i++) {
-            ProfileEntry *e = &profiler.entries[i];
-            if (e->hit_count == 0) continue;
-            
-            float ms = (e->elapsed * 1000.0f) / profiler.freq;
-            float avg_us = (e->elapsed * 1000000.0f) / profiler.freq / e->hit_count;
-            float pct = (e->elapsed * 100.0f) / frame_time;
-            
-            printf("%-30s %10.3f %8d %8.1f %5.1f%%\n", 
-                   e->name, ms, e->hit_count, avg_us, pct);
+        static const char *thread_names[PROFILE_THREADS] = {"main thread", "player render thread"};
+        int rows[PROFILE_THREADS * PZ_COUNT][2];
+        for (int t = 0; t < PROFILE_THREADS; t++) {
+            printf("[%s]\n", thread_names[t]);
+            int n = profile_zone_rows(t, PZ_NONE, 0, rows, 0);
+            for (int i = 0; i < n; i++) {
+                int z = rows[i][0], depth = rows[i][1];
+                ProfileStats s = profile_stats(profiler.total_ms[t][z]);
+                if (s.n == 0) continue;
+                ProfileStats self = profile_stats(profiler.self_ms[t][z]);
+                printf("%*s%-*s %8.3f %8.3f %8.3f %8.3f %8.3f\n", depth * 2, "", 30 - depth * 2,
+                       profile_zone_names[z], s.p50, s.p95, s.p99, s.max, self.p50);
+            }
+            for (int k = 0; k < PC_COUNT; k++) {
+                ProfileStats s = profile_stats(profiler.count[t][k]);
+                if (s.n == 0) continue;
+                printf("%-30s %8.0f %8.0f %8.0f %8.0f\n", profile_counter_names[k], s.p50, s.p95, s.p99, s.max);
+            }
         }
-        printf("================================================================\n\n");
+        printf("==============================================================================\n\n");
+        SDL_UnlockMutex(profiler.lock);
     }
 }
 
 typedef enum { TOOL_SELECT, TOOL_FOG, TOOL_SQUAD, TOOL_DRAW } Tool;
 typedef enum { RANK_NONE, RANK_MINION, RANK_CAPTAIN, RANK_COUNT } TokenRank;
 typedef enum { SHAPE_RECT, SHAPE_CIRCLE } Shape;
+typedef enum { FOG_RENDER_RUNS, FOG_RENDER_MASK, FOG_RENDER_SOFT, FOG_RENDER_COUNT } FogRender;
 typedef enum {
     COND_BLEED, COND_DAZED, COND_FRIGHT, COND_GRABBED,
     COND_RESTRAINED, COND_SLOWED, COND_TAUNTED, COND_WEAK, COND_COUNT
@@ -138,19 +354,58 @@ typedef struct {
     int w, h;
 } Window;
 
+// One decoded RGBA image, shared by both renderers' uploads, map tiles and the save encoder
+typedef struct {
+    unsigned char *pixels;
+    int w, h;
+    uint64_t hash;       // Of the decoded pixels, so the same image under two paths is kept once
+    int refs;            // Unreferenced entries stay cached until pixel_cache_trim needs the memory
+    uint64_t last_used;
+    bool used;
+} PixelEntry;
+
+// Maps are drawn from tiles of a mip pyramid: no texture exceeds the renderer's size limit, and each
+// view only keeps textures for the tiles it has drawn recently, at the detail its zoom needs
+#define MAP_TILE_SIZE 512
+#define MAP_TILE_GUTTER 1            // Edge texels repeated around each tile so filtering has no seams
+#define MAP_MAX_LEVELS 12
+#define MAP_TILE_BUDGET (96u << 20)  // Bytes of tile textures per view before least recently drawn go
+#define MAP_PYRAMID_BUDGET (256u << 20)  // Bytes of decoded map levels before maps away from the current one go
+
+typedef struct {
+    SDL_Texture *tex[2];    // Created on first draw by that view's render thread
+    uint64_t last_used[2];  // Per-view frame stamp, see map_tiles_evict
+} MapTile;
+
+typedef struct {
+    unsigned char *pixels;  // RGBA, level 0 is the full map and each next level half the size
+    int w, h, tiles_x, tiles_y;
+    MapTile *tiles;
+} MapLevel;
+
+typedef struct {
+    MapLevel levels[MAP_MAX_LEVELS];
+    int level_count;
+    PixelEntry *source;  // Holds a reference; level 0 uses its pixels
+    size_t bytes;        // Pixels of all levels
+    uint64_t last_near;  // Ticks when it was last the current map or a neighbour, see map_pyramids_trim
+} MapTiles;
+
 typedef struct {
     char path[256];
     SDL_Texture *tex[2];
+    MapTiles *tiles;  // Maps only, in place of tex
+    unsigned char *blob;  // Compressed file bytes when loaded from a save, which later saves reuse
+    int blob_len;
     int w, h;
     bool loaded;
+    bool queued;  // Decode requested from the asset workers (or failed), see asset_request
 } Asset;
 
 typedef struct {
     int grid_x, grid_y, size, image_idx, damage, squad;
     uint8_t opacity;
     bool hidden, selected, cond[COND_COUNT];
-    SDL_Texture *damage_tex[2];
-    int cached_dmg[2];
     int rank;  // 0=none, 1=minion, 2=captain
     int aura;  // 0=no aura, >0 = aura radius in cells (1 = 3x3, 2 = 5x5, etc.)
 } Token;
@@ -165,29 +420,186 @@ typedef struct {
     float x, y, target_x, target_y, zoom, target_zoom;
 } Camera;
 
+// Fog is a bitset, one bit per cell (1 = revealed), rows padded to whole 64-bit words
+typedef struct {
+    uint64_t *bits;     // See fog_row()
+    int w, h, stride;   // Size in cells, words per row
+    uint32_t version;   // Bumped on every change
+} FogGrid;
+
+typedef struct {
+    int x0, y0, x1, y1;  // Half-open; empty when x0 >= x1
+} DirtyRect;
+
+// Hidden fog merged into rectangles (in cell units) for the visible cell range of one view
+typedef struct {
+    SDL_FRect *cells, *screen;
+    int count, cap;
+    int *open;  // Scratch for merging rows
+    int open_cap;
+    bool valid;
+    uint32_t fog_version;
+    int sc, sr, ec, er;
+} FogRuns;
+
+// Fog as a w x h texture, one texel per cell, stretched over the grid with nearest sampling
+typedef struct {
+    SDL_Texture *tex;
+    int w, h;
+    DirtyRect dirty;         // Cells not yet uploaded (whole rows are uploaded)
+    uint8_t *rows;           // Upload staging, w * h RGBA
+} FogMask;
+
+// Soft fog: the cell grid upsampled to a texel mask and box blurred, updated only around changed cells
+#define SOFT_FOG_MAX_SCALE 4       // Texels per cell edge
+#define SOFT_FOG_MAX_TEXELS 2048   // Scale is reduced so the mask stays under this per side
+#define SOFT_FOG_RADIUS 3          // Box blur radius in texels
+#define SOFT_FOG_NORM (65536 / ((2*SOFT_FOG_RADIUS + 1) * (2*SOFT_FOG_RADIUS + 1)) + 1)
+
 typedef struct {
+    int scale, w, h;         // Texels per cell edge, mask size in texels
+    int grid_w, grid_h;      // Fog size the buffers were built for
+    uint8_t *src;            // Hard mask (255 = hidden) with SOFT_FOG_RADIUS texels of edge padding
+    uint16_t *tmp;           // Horizontal sums, w x (h + 2 * radius)
+    uint16_t *acc;           // Vertical sums for one row
+    uint8_t *alpha;          // Blurred mask, w x h
+    DirtyRect dirty;         // Cells changed since the last blur
     SDL_Texture *tex;
+    uint8_t *rgba;           // Upload staging
+    DirtyRect upload;        // Texels blurred but not yet uploaded
+} SoftFog;
+
+typedef struct {
     char text[64];
     int w, h;
+    SDL_Color col;
 } CachedText;
 
+// Glyph atlas: printable ASCII rasterized once per renderer and font size bucket
+#define GLYPH_FIRST 32
+#define GLYPH_LAST 126
+#define GLYPH_COUNT (GLYPH_LAST - GLYPH_FIRST + 1)
+#define ATLAS_WIDTH 512
+#define ATLAS_BUCKETS 8
+static const float atlas_bucket_sizes[ATLAS_BUCKETS] = {8, 12, 16, 20, 24, 32, 48, 64};
+
+typedef struct {
+    int x, y, w, h;     // Rect in atlas texture
+    int xoff, yoff;     // Bitmap offset from pen position (bucket pixels)
+} Glyph;
+
+typedef struct {
+    SDL_Texture *tex;
+    int tex_w, tex_h;
+    float size, scale;  // Bucket pixel height and stbtt scale for it
+    Glyph glyphs[GLYPH_COUNT];
+} GlyphAtlas;
+
+// Rank letters are baked per quarter-octave of zoom and scaled to the exact size when drawn
+#define RANK_LETTER_SIZE 96.0f
+#define RANK_ZOOM_STEPS 4       // Buckets per doubling of zoom
+#define RANK_ZOOM_BUCKETS 32    // Covers zoom 1/16x .. 16x
+
+typedef struct {
+    SDL_Texture *tex;
+    int w, h;
+    float size;         // Font size the texture was baked at
+} RankLetter;
+
+// Growable slot storage. A slot keeps its number while live, so indices held elsewhere (drag,
+// condition wheel, token index) survive other deletions; freed slots are reused from a free list.
+// Live slots are linked oldest first, which is their drawing order.
+typedef struct {
+    void *items;
+    size_t item_size;
+    int *next, *prev;   // Links between live slots; free slots are chained through next
+    uint32_t *seq;      // Creation stamp, increasing along the drawing order
+    bool *live;
+    int cap, count;
+    int head, tail, free;
+    uint32_t next_seq;
+} Pool;
+
+// Visits live slots in drawing order. The body may free slot i but no other.
+#define POOL_FOR(p, i) for (int i = (p).head, i##_next; i >= 0 && (i##_next = (p).next[i], 1); i = i##_next)
+
+// Indices into a TokenStore of the tokens that pass culling for one view, per layer
+typedef struct {
+    int *auras, *tokens, *markers;
+    int aura_count, token_count, marker_count, cap;
+    int auras_culled, tokens_culled, markers_culled;  // Counted by the view that draws them
+} TokenCull;
+
+// Tokens of a scene: full records, copied in drawing order, of only the tokens some layer of the
+// view draws (see token_cull)
+typedef struct {
+    Token *rec;
+    int count, cap;
+    TokenCull cull;
+    int selected;  // Record of the first selected token, copied even when off screen; -1 if none
+} TokenStore;
+
+// Quads for one SDL_RenderGeometry call, grown as needed
+typedef struct {
+    SDL_Vertex *verts;
+    int *indices;
+    int quads, cap;
+} QuadBatch;
+
+// Per-view scratch for the batched token layers (see render_tokens)
+typedef struct {
+    QuadBatch colors, sprites;  // Untextured quads; quads of the texture being drawn
+} TokenBatch;
+
+#define TOKEN_RUN_MAX 128  // Tokens drawn together at most, which bounds the overlap test in render_tokens
+
+// Everything render_view reads that the DM can change. The DM view renders from a scene that
+// aliases live state; the player view renders on its own thread from a snapshot (see player_scene_capture).
+typedef struct {
+    const TokenStore *tokens;
+    const Drawing *drawings;
+    int drawing_count;
+    FogGrid fog;
+    DirtyRect fog_dirty;     // Cells changed since this view's previous frame
+    FogRender fog_render;
+    int grid_size, grid_off_x, grid_off_y;
+    int map_current;         // Index into map_assets, -1 for none
+    Camera cam;
+    int win_w, win_h;
+    float mouse_x, mouse_y;  // DM window mouse position, for the measurement line
+    bool measure_active;
+    int measure_start_gx, measure_start_gy;
+} Scene;
+
 static struct {
     Window dm, player;
     Asset map_assets[MAX_ASSETS];
     int map_count, map_current;
+    MapTile **map_resident[2];  // Tiles holding a texture for each view
+    int map_resident_count[2], map_resident_cap[2];
+    uint64_t map_frame[2];
     Asset token_lib[MAX_ASSETS];
     int token_lib_count;
     
-    Token tokens[MAX_TOKENS];
-    int token_count;
-    Drawing drawings[MAX_DRAWINGS];
-    int drawing_count;
+    Token *tokens;        // Items of token_pool, indexed by slot
+    Pool token_pool;
+    Drawing *drawings;    // Items of drawing_pool, indexed by slot
+    Pool drawing_pool;
     
-    bool *fog;
-    int fog_w, fog_h, grid_size, grid_off_x, grid_off_y;
+    FogGrid fog;
+    DirtyRect fog_changed[2];  // Cells changed since each view last took the fog
+    DirtyRect fog_journal;     // Cells changed since the autosave journal last recorded fog
+    int grid_size, grid_off_x, grid_off_y;
+    FogRuns fog_runs[2];
+    TokenBatch token_batch[2];
+    FogMask fog_mask[2];
+    SoftFog fog_soft[2];
+    FogRender fog_render;
     int map_w, map_h;
     
     Camera cam[2];
+    bool view_dirty[2];  // View needs to be redrawn and presented
+    uint64_t input_ns;   // Timestamp of the oldest input not yet presented, 0 if none
     bool sync_views;
     bool show_grid;
     Tool tool;
@@ -195,6 +607,7 @@ static struct {
     
     bool drag_token, paint_fog, fog_mode, draw_shape, shift, ctrl;
     int drag_idx, paint_start_x, paint_start_y;
+    int drag_off_x, drag_off_y;  // Dragged token's anchor cell relative to the cell under the mouse
     float last_mx, last_my;
     int fog_brush_size;
     
@@ -212,11 +625,10 @@ static struct {
     
     stbtt_fontinfo font;
     unsigned char *font_data;
-    SDL_Texture *cond_tex[2][COND_COUNT];  // 2-letter abbreviations for tokens [view][cond]
-    SDL_Texture *cond_wheel_tex[COND_COUNT];  // Full names for wheel
-    int cond_w, cond_h;
+    GlyphAtlas atlas[2][ATLAS_BUCKETS];  // [view][size bucket], built on first use
+    RankLetter rank_letters[2][RANK_COUNT][RANK_ZOOM_BUCKETS];  // [view][rank][zoom bucket], shared by all tokens
     
-    CachedText ui_tool, ui_squad, ui_dmg, ui_help, ui_calibration;
+    CachedText ui_tool, ui_squad, ui_dmg, ui_help, ui_calibration, ui_save;
     CachedText ui_measure[2];  // Per-view measurement text
     Tool cached_tool;
     bool cached_cal_drag;
@@ -238,6 +650,33 @@ static struct {
     float touch_start_cam_x, touch_start_cam_y;  // Camera position at gesture start
 } g;
 
+// Player view render thread. The main thread fills the snapshot only while the thread is idle, then
+// signals it; the thread renders and presents, then clears busy.
+static struct {
+    SDL_Thread *thread;
+    SDL_Semaphore *go;
+    SDL_Mutex *lock;         // Held while rendering; the main thread takes it to touch the player renderer
+    SDL_AtomicInt busy;      // Snapshot handed off and not yet presented
+    SDL_AtomicInt quit;
+    Scene scene;             // Points into the copies below
+    TokenStore tokens;
+    Drawing *drawings;
+    int drawing_cap;
+    uint64_t *fog_bits;      // Copy of g.fog, refreshed by changed rows
+} player_rt;
+
+// Background save state (see save_slot_async), shown in the DM panel
+static struct {
+    SDL_AtomicInt busy;      // A save is being written
+    SDL_AtomicInt progress;  // Per mille of the bytes written
+    bool ok;                 // Result of the last save, read once busy drops
+    bool reported;
+    int slot;
+    int queued;              // Slot + 1 of a manual save waiting for an autosave snapshot, 0 if none
+    uint64_t notice_until;   // Ticks until which the result stays in the DM panel
+    uint32_t event;          // Pushed on progress and completion so the DM view redraws
+} save_rt;
+
 static bool is_image(const char *f) {
     const char *e = strrchr(f, '.');
     if (!e) return false;
@@ -263,72 +702,640 @@ static void scan_assets(const char *dir, Asset *arr, int *count) {
             }
 }
 
-static SDL_Texture* bake_text_once(SDL_Renderer *r, const char *s, int *out_w, int *out_h, SDL_Color col, float font_size) {
-    if (!g.font_data || !s[0]) return NULL;
-    float scale = stbtt_ScaleForPixelHeight(&g.font, font_size);
-    int ascent; stbtt_GetFontVMetrics(&g.font, &ascent, NULL, NULL);
+static float text_advance(const char *s, float scale) {
     float x = 0;
     for (int i = 0; s[i]; i++) {
         int adv, lsb; stbtt_GetCodepointHMetrics(&g.font, s[i], &adv, &lsb);
         x += adv * scale + (s[i+1] ? stbtt_GetCodepointKernAdvance(&g.font, s[i], s[i+1]) * scale : 0);
     }
-    int w = (int)x + 8, h = (int)font_size + 8;
-    SDL_Texture *t = SDL_CreateTexture(r, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h);
-    if (!t) return NULL;
-    SDL_SetRenderTarget(r, t);
-    SDL_SetRenderDrawColor(r, 0, 0, 0, 0);
-    SDL_RenderClear(r);
-    x = 4;
+    return x;
+}
+
+// Rasterizes a string into a CPU buffer and uploads it in one call (for large one-off text)
+static SDL_Texture* bake_text_once(SDL_Renderer *r, const char *s, int *out_w, int *out_h, SDL_Color col, float font_size) {
+    if (!g.font_data || !s[0]) return NULL;
+    float scale = stbtt_ScaleForPixelHeight(&g.font, font_size);
+    int ascent; stbtt_GetFontVMetrics(&g.font, &ascent, NULL, NULL);
+    int w = (int)text_advance(s, scale) + 8, h = (int)font_size + 8;
+    uint8_t *pixels = calloc((size_t)w * h, 4);
+    if (!pixels) return NULL;
+    float x = 4;
     float y = 4 + ascent * scale;
     for (int i = 0; s[i]; i++) {
         int adv, lsb; stbtt_GetCodepointHMetrics(&g.font, s[i], &adv, &lsb);
         int gw, gh, xoff, yoff;
         unsigned char *bmp = stbtt_GetCodepointBitmap(&g.font, 0, scale, s[i], &gw, &gh, &xoff, &yoff);
         if (bmp) {
-            for (int py = 0; py < gh; py++) for (int px = 0; px < gw; px++) {
-                if ((int)x+px+xoff >= 0 && (int)x+px+xoff < w && (int)y+py+yoff >= 0 && (int)y+py+yoff < h && bmp[py*gw+px]) {
-                    SDL_SetRenderDrawColor(r, col.r, col.g, col.b, bmp[py*gw+px]);
-                    SDL_RenderPoint(r, x+px+xoff, y+py+yoff);
+            for (int py = 0; py < gh; py++) {
+                int dy = (int)y + py + yoff;
+                if (dy < 0 || dy >= h) continue;
+                for (int px = 0; px < gw; px++) {
+                    int dx = (int)x + px + xoff;
+                    uint8_t a = bmp[py*gw+px];
+                    if (dx < 0 || dx >= w || !a) continue;
+                    uint8_t *p = &pixels[(dy*w + dx) * 4];
+                    if (a > p[3]) { p[0] = col.r; p[1] = col.g; p[2] = col.b; p[3] = a; }
                 }
             }
             stbtt_FreeBitmap(bmp, NULL);
         }
         x += adv * scale;
     }
-    SDL_SetRenderTarget(r, NULL);
-    SDL_SetTextureBlendMode(t, SDL_BLENDMODE_BLEND);
-    *out_w = w; *out_h = h;
+    SDL_Texture *t = SDL_CreateTexture(r, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, w, h);
+    if (t) {
+        SDL_UpdateTexture(t, NULL, pixels, w * 4);
+        SDL_SetTextureBlendMode(t, SDL_BLENDMODE_BLEND);
+        *out_w = w; *out_h = h;
+    }
+    free(pixels);
     return t;
 }
 
-static void update_cached_text(CachedText *c, SDL_Renderer *r, const char *s, SDL_Color col) {
-    if (c->tex && !strcmp(c->text, s)) return;
-    if (c->tex) SDL_DestroyTexture(c->tex);
+static void glyph_atlas_build(GlyphAtlas *a, SDL_Renderer *r, float size) {
+    a->size = size;
+    a->scale = stbtt_ScaleForPixelHeight(&g.font, size);
+    
+    // Shelf-pack glyph boxes to find atlas height
+    int pen_x = 1, pen_y = 1, row_h = 0;
+    for (int i = 0; i < GLYPH_COUNT; i++) {
+        Glyph *gl = &a->glyphs[i];
+        int x0, y0, x1, y1;
+        stbtt_GetCodepointBitmapBox(&g.font, GLYPH_FIRST + i, a->scale, a->scale, &x0, &y0, &x1, &y1);
+        gl->w = x1 - x0; gl->h = y1 - y0;
+        gl->xoff = x0; gl->yoff = y0;
+        if (pen_x + gl->w + 1 > ATLAS_WIDTH) {
+            pen_x = 1;
+            pen_y += row_h + 1;
+            row_h = 0;
+        }
+        gl->x = pen_x; gl->y = pen_y;
+        pen_x += gl->w + 1;
+        if (gl->h > row_h) row_h = gl->h;
+    }
+    a->tex_w = ATLAS_WIDTH;
+    a->tex_h = pen_y + row_h + 1;
+    
+    uint8_t *alpha = calloc((size_t)a->tex_w * a->tex_h, 1);
+    uint8_t *pixels = malloc((size_t)a->tex_w * a->tex_h * 4);
+    if (alpha && pixels) {
+        for (int i = 0; i < GLYPH_COUNT; i++) {
+            Glyph *gl = &a->glyphs[i];
+            if (gl->w > 0 && gl->h > 0)
+                stbtt_MakeCodepointBitmap(&g.font, alpha + gl->y*a->tex_w + gl->x, gl->w, gl->h,
+                                          a->tex_w, a->scale, a->scale, GLYPH_FIRST + i);
+        }
+        // White glyphs with coverage in alpha, tinted per vertex when drawn
+        for (int i = 0; i < a->tex_w * a->tex_h; i++) {
+            pixels[i*4+0] = pixels[i*4+1] = pixels[i*4+2] = 255;
+            pixels[i*4+3] = alpha[i];
+        }
+        a->tex = SDL_CreateTexture(r, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, a->tex_w, a->tex_h);
+        if (a->tex) {
+            SDL_UpdateTexture(a->tex, NULL, pixels, a->tex_w * 4);
+            SDL_SetTextureBlendMode(a->tex, SDL_BLENDMODE_BLEND);
+        }
+    }
+    free(alpha);
+    free(pixels);
+}
+
+// Smallest bucket that covers the on-screen pixel size (largest bucket is scaled up)
+static GlyphAtlas* glyph_atlas_get(SDL_Renderer *r, float px) {
+    int view = (r == g.player.ren) ? 1 : 0;
+    int b = 0;
+    while (b < ATLAS_BUCKETS - 1 && atlas_bucket_sizes[b] < px) b++;
+    GlyphAtlas *a = &g.atlas[view][b];
+    if (!a->tex) glyph_atlas_build(a, r, atlas_bucket_sizes[b]);
+    return a->tex ? a : NULL;
+}
+
+// Box size matches bake_text_once: advance + 4px padding on each side
+static void text_measure(const char *s, float font_size, int *out_w, int *out_h) {
+    float scale = stbtt_ScaleForPixelHeight(&g.font, font_size);
+    *out_w = (int)text_advance(s, scale) + 8;
+    *out_h = (int)font_size + 8;
+}
+
+// Draws a string as one batched geometry call; (x, y) is the top-left of its measured box
+static void text_draw(SDL_Renderer *r, const char *s, float x, float y, float font_size, float zoom, SDL_Color col) {
+    if (!g.font_data || !s[0]) return;
+    GlyphAtlas *a = glyph_atlas_get(r, font_size * zoom);
+    if (!a) return;
+    
+    SDL_Vertex verts[256 * 4];  // On the stack: called from both render threads
+    int indices[256 * 6];
+    int n = 0;
+    float k = font_size * zoom / a->size;  // Bucket pixels -> screen pixels
+    float scale = a->scale * k;
+    int ascent; stbtt_GetFontVMetrics(&g.font, &ascent, NULL, NULL);
+    float pen_x = x + 4 * zoom;
+    float base_y = y + 4 * zoom + ascent * scale;
+    SDL_FColor fc = {col.r / 255.0f, col.g / 255.0f, col.b / 255.0f, col.a / 255.0f};
+    
+    for (int i = 0; s[i] && n < 256; i++) {
+        int c = (unsigned char)s[i];
+        int adv, lsb; stbtt_GetCodepointHMetrics(&g.font, c, &adv, &lsb);
+        if (c >= GLYPH_FIRST && c <= GLYPH_LAST) {
+            Glyph *gl = &a->glyphs[c - GLYPH_FIRST];
+            if (gl->w > 0 && gl->h > 0) {
+                float x0 = pen_x + gl->xoff * k, y0 = base_y + gl->yoff * k;
+                float x1 = x0 + gl->w * k, y1 = y0 + gl->h * k;
+                float u0 = (float)gl->x / a->tex_w, v0 = (float)gl->y / a->tex_h;
+                float u1 = (float)(gl->x + gl->w) / a->tex_w, v1 = (float)(gl->y + gl->h) / a->tex_h;
+                SDL_Vertex *v = &verts[n*4];
+                v[0] = (SDL_Vertex){{x0, y0}, fc, {u0, v0}};
+                v[1] = (SDL_Vertex){{x1, y0}, fc, {u1, v0}};
+                v[2] = (SDL_Vertex){{x1, y1}, fc, {u1, v1}};
+                v[3] = (SDL_Vertex){{x0, y1}, fc, {u0, v1}};
+                int *ix = &indices[n*6];
+                ix[0] = n*4; ix[1] = n*4+1; ix[2] = n*4+2;
+                ix[3] = n*4; ix[4] = n*4+2; ix[5] = n*4+3;
+                n++;
+            }
+        }
+        pen_x += adv * scale + (s[i+1] ? stbtt_GetCodepointKernAdvance(&g.font, c, s[i+1]) * scale : 0);
+    }
+    if (n > 0) SDL_RenderGeometry(r, a->tex, verts, n*4, indices, n*6);
+}
+
+static RankLetter* rank_letter_get(SDL_Renderer *r, int view, int rank, float zoom) {
+    // Camera zoom eases in from 0 on the first frames
+    int b = (int)floorf(log2f(fmaxf(zoom, 1.0f / 64)) * RANK_ZOOM_STEPS + 0.5f) + RANK_ZOOM_BUCKETS / 2;
+    if (b < 0) b = 0;
+    if (b >= RANK_ZOOM_BUCKETS) b = RANK_ZOOM_BUCKETS - 1;
+    RankLetter *l = &g.rank_letters[view][rank][b];
+    if (!l->tex) {
+        l->size = RANK_LETTER_SIZE * exp2f((float)(b - RANK_ZOOM_BUCKETS / 2) / RANK_ZOOM_STEPS);
+        l->tex = bake_text_once(r, rank == RANK_MINION ? "M" : "C", &l->w, &l->h, (SDL_Color){0,0,0,255}, l->size);
+    }
+    return l->tex ? l : NULL;
+}
+
+static void update_cached_text(CachedText *c, const char *s, SDL_Color col) {
+    c->col = col;
+    if (c->text[0] && !strcmp(c->text, s)) return;
     strncpy(c->text, s, 63);
-    c->tex = bake_text_once(r, s, &c->w, &c->h, col, 20.0f);
+    c->text[63] = '\0';
+    if (g.font_data) text_measure(c->text, 20.0f, &c->w, &c->h);
+}
+
+static void draw_cached_text(SDL_Renderer *r, const CachedText *c, float x, float y) {
+    text_draw(r, c->text, x, y, 20.0f, 1.0f, c->col);
 }
 
 static void draw_ui_panel(SDL_Renderer *r, float x, float y, float w, float h, 
-                          SDL_Color bg, SDL_Color border, SDL_Texture *tex, float pad_x, float pad_y) {
+                          SDL_Color bg, SDL_Color border, const CachedText *text, float pad_x, float pad_y) {
     SDL_SetRenderDrawColor(r, bg.r, bg.g, bg.b, bg.a);
     SDL_RenderFillRect(r, &(SDL_FRect){x, y, w, h});
     SDL_SetRenderDrawColor(r, border.r, border.g, border.b, border.a);
     SDL_RenderRect(r, &(SDL_FRect){x, y, w, h});
-    if (tex) {
-        float tex_w, tex_h;
-        SDL_GetTextureSize(tex, &tex_w, &tex_h);
-        SDL_RenderTexture(r, tex, NULL, &(SDL_FRect){x + pad_x, y + pad_y, tex_w, tex_h});
+    if (text) draw_cached_text(r, text, x + pad_x, y + pad_y);
+}
+
+// Profiler overlay (F12): frame work time graph over the history, then zone percentiles and counters per thread
+static void profile_draw_overlay(SDL_Renderer *r, int win_w) {
+    const float bar_w = 2, graph_h = 100, pad = 10, line_h = 18;
+    const float panel_w = PROFILE_HISTORY * bar_w + 2 * pad;
+    float x0 = win_w - panel_w - 10, y0 = 10;
+    SDL_FRect ok[PROFILE_HISTORY], slow[PROFILE_HISTORY], player[PROFILE_HISTORY];
+    int n_ok = 0, n_slow = 0, n_player = 0;
+    int rows[PROFILE_THREADS][PROFILE_THREADS * PZ_COUNT][2];
+    int n_rows[PROFILE_THREADS];
+    
+    SDL_LockMutex(profiler.lock);
+    // Bars are scaled so twice the budget fills the graph; the player thread's render time is a mark per frame
+    float scale = graph_h / (2 * profiler.budget_ms);
+    float gx = x0 + pad, gy = y0 + pad;
+    for (int i = 0; i < profiler.frames; i++) {
+        int idx = (profiler.head - profiler.frames + i + PROFILE_HISTORY) % PROFILE_HISTORY;
+        float ms = profiler.frame_ms[idx];
+        float h = fminf(ms * scale, graph_h);
+        SDL_FRect bar = {gx + i * bar_w, gy + graph_h - h, bar_w, h};
+        if (ms <= profiler.budget_ms) ok[n_ok++] = bar; else slow[n_slow++] = bar;
+        float pm = profiler.total_ms[1][PZ_render_player][idx];
+        if (pm >= 0) player[n_player++] = (SDL_FRect){gx + i * bar_w, gy + graph_h - fminf(pm * scale, graph_h) - 1, bar_w, 2};
+    }
+    int total_rows = 0;
+    for (int t = 0; t < PROFILE_THREADS; t++) {
+        n_rows[t] = profile_zone_rows(t, PZ_NONE, 0, rows[t], 0);
+        total_rows += n_rows[t] + 1;
+        for (int k = 0; k < PC_COUNT; k++) total_rows += profile_stats(profiler.count[t][k]).n > 0;
+    }
+    
+    float panel_h = graph_h + 2 * pad + (total_rows + 2) * line_h + pad;
+    SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(r, 20, 20, 30, 220);
+    SDL_RenderFillRect(r, &(SDL_FRect){x0, y0, panel_w, panel_h});
+    SDL_SetRenderDrawColor(r, 100, 100, 150, 255);
+    SDL_RenderRect(r, &(SDL_FRect){x0, y0, panel_w, panel_h});
+    SDL_SetRenderDrawColor(r, 80, 200, 80, 255);
+    if (n_ok) SDL_RenderFillRects(r, ok, n_ok);
+    SDL_SetRenderDrawColor(r, 230, 70, 50, 255);
+    if (n_slow) SDL_RenderFillRects(r, slow, n_slow);
+    SDL_SetRenderDrawColor(r, 80, 200, 255, 255);
+    if (n_player) SDL_RenderFillRects(r, player, n_player);
+    SDL_SetRenderDrawColor(r, 255, 255, 100, 160);
+    SDL_RenderLine(r, gx, gy + graph_h / 2, gx + PROFILE_HISTORY * bar_w, gy + graph_h / 2);  // Budget
+    
+    if (g.font_data) {
+        static const char *thread_names[PROFILE_THREADS] = {"main thread", "player render thread"};
+        static const char *cols[4] = {"p50", "p95", "p99", "max"};
+        const float col_x[4] = {230, 290, 350, 410};
+        SDL_Color white = {255, 255, 255, 255}, dim = {170, 170, 200, 255};
+        char buf[64];
+        float y = gy + graph_h + pad;
+        
+        ProfileStats fs = profile_stats(profiler.frame_ms);
+        text_draw(r, "frame (ms)", gx, y, 14.0f, 1.0f, white);
+        for (int c = 0; c < 4; c++) text_draw(r, cols[c], gx + col_x[c], y, 14.0f, 1.0f, dim);
+        y += line_h;
+        float fv[4] = {fs.p50, fs.p95, fs.p99, fs.max};
+        for (int c = 0; c < 4; c++) {
+            snprintf(buf, sizeof(buf), "%.2f", fv[c]);
+            text_draw(r, buf, gx + col_x[c], y, 14.0f, 1.0f, white);
+        }
+        y += line_h;
+        for (int t = 0; t < PROFILE_THREADS; t++) {
+            text_draw(r, thread_names[t], gx, y, 14.0f, 1.0f, dim);
+            y += line_h;
+            for (int i = 0; i < n_rows[t]; i++) {
+                int z = rows[t][i][0], depth = rows[t][i][1];
+                ProfileStats s = profile_stats(profiler.total_ms[t][z]);
+                if (s.n == 0) continue;
+                text_draw(r, profile_zone_names[z], gx + 10 + depth * 12, y, 14.0f, 1.0f, white);
+                float v[4] = {s.p50, s.p95, s.p99, s.max};
+                for (int c = 0; c < 4; c++) {
+                    snprintf(buf, sizeof(buf), "%.2f", v[c]);
+                    text_draw(r, buf, gx + col_x[c], y, 14.0f, 1.0f, v[c] > profiler.budget_ms ? (SDL_Color){255, 120, 100, 255} : white);
+                }
+                y += line_h;
+            }
+            for (int k = 0; k < PC_COUNT; k++) {
+                ProfileStats s = profile_stats(profiler.count[t][k]);
+                if (s.n == 0) continue;
+                text_draw(r, profile_counter_names[k], gx + 10, y, 14.0f, 1.0f, dim);
+                float v[4] = {s.p50, s.p95, s.p99, s.max};
+                for (int c = 0; c < 4; c++) {
+                    snprintf(buf, sizeof(buf), "%.0f", v[c]);
+                    text_draw(r, buf, gx + col_x[c], y, 14.0f, 1.0f, dim);
+                }
+                y += line_h;
+            }
+        }
     }
+    SDL_UnlockMutex(profiler.lock);
 }
 
-static int load_asset_from_pixels(unsigned char *pixels, int w, int h, Asset *slot, const char *name) {
+// Decoded pixel cache. Lookups are by path (several paths may share an entry through the content
+// hash); decoding runs outside the lock so asset workers can use it concurrently.
+#define PIXEL_CACHE_ENTRIES (2 * MAX_ASSETS)
+#define PIXEL_CACHE_NAMES (4 * MAX_ASSETS)
+
+static struct {
+    SDL_Mutex *lock;
+    PixelEntry entries[PIXEL_CACHE_ENTRIES];
+    struct { char path[256]; PixelEntry *entry; } names[PIXEL_CACHE_NAMES];
+    int name_count;
+    size_t bytes, cap;  // cap from --pixel-cache-mb; referenced entries may exceed it
+    uint64_t tick;
+} pixel_cache = {.cap = (size_t)512 << 20};
+
+static uint64_t hash_bytes(const unsigned char *data, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ull;  // FNV-1a over 64-bit words, then the tail bytes
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, data + i, 8);
+        h = (h ^ v) * 0x100000001b3ull;
+    }
+    for (; i < len; i++) h = (h ^ data[i]) * 0x100000001b3ull;
+    return h;
+}
+
+static void pixel_cache_forget(PixelEntry *e) {  // Lock held, e unreferenced
+    for (int i = 0; i < pixel_cache.name_count; ) {
+        if (pixel_cache.names[i].entry == e) pixel_cache.names[i] = pixel_cache.names[--pixel_cache.name_count];
+        else i++;
+    }
+    pixel_cache.bytes -= (size_t)e->w * e->h * 4;
+    free(e->pixels);
+    memset(e, 0, sizeof(*e));
+}
+
+// Frees least recently used unreferenced entries until under the cap. Lock held.
+static void pixel_cache_trim(size_t cap) {
+    while (pixel_cache.bytes > cap) {
+        PixelEntry *oldest = NULL;
+        for (int i = 0; i < PIXEL_CACHE_ENTRIES; i++) {
+            PixelEntry *e = &pixel_cache.entries[i];
+            if (e->used && e->refs == 0 && (!oldest || e->last_used < oldest->last_used)) oldest = e;
+        }
+        if (!oldest) break;
+        pixel_cache_forget(oldest);
+    }
+}
+
+static void pixel_cache_name(const char *path, PixelEntry *e) {  // Lock held
+    for (int i = 0; i < pixel_cache.name_count; i++) {
+        if (strcmp(pixel_cache.names[i].path, path)) continue;
+        pixel_cache.names[i].entry = e;  // Decoded again by another worker, or different content
+        return;
+    }
+    if (pixel_cache.name_count == PIXEL_CACHE_NAMES) return;  // Still usable, just not found by path
+    strncpy(pixel_cache.names[pixel_cache.name_count].path, path, 255);
+    pixel_cache.names[pixel_cache.name_count].path[255] = '\0';
+    pixel_cache.names[pixel_cache.name_count++].entry = e;
+}
+
+static PixelEntry *pixel_cache_find(const char *path) {  // Lock held; returns a new reference
+    for (int i = 0; i < pixel_cache.name_count; i++) {
+        if (strcmp(pixel_cache.names[i].path, path)) continue;
+        PixelEntry *e = pixel_cache.names[i].entry;
+        e->refs++;
+        e->last_used = ++pixel_cache.tick;
+        return e;
+    }
+    return NULL;
+}
+
+// Takes ownership of malloc'd RGBA pixels and returns a reference to the entry holding them,
+// which is an existing one if the content is already cached
+static PixelEntry *pixel_cache_insert(const char *path, unsigned char *pixels, int w, int h) {
+    uint64_t hash = hash_bytes(pixels, (size_t)w * h * 4);
+    SDL_LockMutex(pixel_cache.lock);
+    PixelEntry *e = NULL, *free_slot = NULL;
+    for (int i = 0; i < PIXEL_CACHE_ENTRIES && !e; i++) {
+        PixelEntry *c = &pixel_cache.entries[i];
+        if (!c->used) { if (!free_slot) free_slot = c; continue; }
+        if (c->hash == hash && c->w == w && c->h == h && !memcmp(c->pixels, pixels, (size_t)w * h * 4)) e = c;
+    }
+    if (e) {
+        free(pixels);
+    } else {
+        pixel_cache_trim(pixel_cache.cap > (size_t)w * h * 4 ? pixel_cache.cap - (size_t)w * h * 4 : 0);
+        if (!free_slot) {  // Trimming may have freed one
+            for (int i = 0; i < PIXEL_CACHE_ENTRIES && !free_slot; i++)
+                if (!pixel_cache.entries[i].used) free_slot = &pixel_cache.entries[i];
+        }
+        if (!free_slot) {
+            SDL_UnlockMutex(pixel_cache.lock);
+            free(pixels);
+            return NULL;
+        }
+        e = free_slot;
+        *e = (PixelEntry){pixels, w, h, hash, 0, 0, true};
+        pixel_cache.bytes += (size_t)w * h * 4;
+    }
+    e->refs++;
+    e->last_used = ++pixel_cache.tick;
+    pixel_cache_name(path, e);
+    SDL_UnlockMutex(pixel_cache.lock);
+    return e;
+}
+
+static PixelEntry *pixel_cache_load(const char *path) {
+    SDL_LockMutex(pixel_cache.lock);
+    PixelEntry *e = pixel_cache_find(path);
+    SDL_UnlockMutex(pixel_cache.lock);
+    if (e) return e;
+    int w, h;
+    unsigned char *pixels = stbi_load(path, &w, &h, NULL, 4);
+    return pixels ? pixel_cache_insert(path, pixels, w, h) : NULL;
+}
+
+static PixelEntry *pixel_cache_load_memory(const char *name, const unsigned char *data, int len) {
+    int w, h;
+    unsigned char *pixels = stbi_load_from_memory(data, len, &w, &h, NULL, 4);
+    return pixels ? pixel_cache_insert(name, pixels, w, h) : NULL;
+}
+
+static void pixel_cache_retain(PixelEntry *e) {
+    SDL_LockMutex(pixel_cache.lock);
+    e->refs++;
+    SDL_UnlockMutex(pixel_cache.lock);
+}
+
+static void pixel_cache_release(PixelEntry *e) {
+    if (!e) return;
+    SDL_LockMutex(pixel_cache.lock);
+    e->refs--;
+    pixel_cache_trim(pixel_cache.cap);
+    SDL_UnlockMutex(pixel_cache.lock);
+}
+
+static bool asset_is_map(const Asset *slot) {
+    return slot >= g.map_assets && slot < g.map_assets + MAX_ASSETS;
+}
+
+static void map_tiles_free(MapTiles *mt) {
+    if (!mt) return;
+    for (int i = 0; i < mt->level_count; i++) {
+        if (i > 0) free(mt->levels[i].pixels);
+        free(mt->levels[i].tiles);
+    }
+    pixel_cache_release(mt->source);
+    free(mt);
+}
+
+// Builds the level pyramid on top of a cached decode, taking over the caller's reference to it.
+// Each further level is a 2x2 box filter of the previous one, down to a single tile.
+// Touches no renderer state, so asset workers run it off the main thread.
+static MapTiles *map_tiles_build(PixelEntry *source) {
+    MapTiles *mt = calloc(1, sizeof(MapTiles));
+    if (!mt) {
+        pixel_cache_release(source);
+        return NULL;
+    }
+    mt->source = source;
+    unsigned char *pixels = source->pixels;
+    int w = source->w, h = source->h;
+    while (mt->level_count < MAP_MAX_LEVELS) {
+        MapLevel *l = &mt->levels[mt->level_count];
+        l->pixels = pixels; l->w = w; l->h = h;
+        l->tiles_x = (w + MAP_TILE_SIZE - 1) / MAP_TILE_SIZE;
+        l->tiles_y = (h + MAP_TILE_SIZE - 1) / MAP_TILE_SIZE;
+        l->tiles = calloc((size_t)l->tiles_x * l->tiles_y, sizeof(MapTile));
+        if (!l->tiles) {
+            if (mt->level_count > 0) free(pixels);
+            l->pixels = NULL;
+            break;
+        }
+        mt->level_count++;
+        mt->bytes += (size_t)w * h * 4;
+        if (w <= MAP_TILE_SIZE && h <= MAP_TILE_SIZE) break;
+        
+        int nw = (w + 1) / 2, nh = (h + 1) / 2;
+        unsigned char *next = malloc((size_t)nw * nh * 4);
+        if (!next) break;
+        for (int y = 0; y < nh; y++) {
+            const unsigned char *r0 = pixels + (size_t)(2*y) * w * 4;
+            const unsigned char *r1 = pixels + (size_t)(2*y + 1 < h ? 2*y + 1 : 2*y) * w * 4;
+            unsigned char *out = next + (size_t)y * nw * 4;
+            for (int x = 0; x < nw; x++) {
+                int x0 = 2*x * 4, x1 = (2*x + 1 < w ? 2*x + 1 : 2*x) * 4;
+                for (int ch = 0; ch < 4; ch++)
+                    out[x*4 + ch] = (uint8_t)((r0[x0 + ch] + r0[x1 + ch] + r1[x0 + ch] + r1[x1 + ch] + 2) / 4);
+            }
+        }
+        pixels = next; w = nw; h = nh;
+    }
+    if (mt->level_count == 0) {
+        map_tiles_free(mt);
+        return NULL;
+    }
+    return mt;
+}
+
+static SDL_Texture *map_tile_upload(SDL_Renderer *r, const MapLevel *l, int tx, int ty) {
+    const int gut = MAP_TILE_GUTTER;
+    int x0 = tx * MAP_TILE_SIZE, y0 = ty * MAP_TILE_SIZE;
+    int tw = SDL_min(MAP_TILE_SIZE, l->w - x0) + 2*gut, th = SDL_min(MAP_TILE_SIZE, l->h - y0) + 2*gut;
+    uint32_t *buf = malloc((size_t)tw * th * 4);
+    if (!buf) return NULL;
+    for (int y = 0; y < th; y++) {
+        int sy = SDL_clamp(y0 + y - gut, 0, l->h - 1);
+        const uint32_t *src = (const uint32_t*)(l->pixels + (size_t)sy * l->w * 4);
+        for (int x = 0; x < tw; x++)
+            buf[y*tw + x] = src[SDL_clamp(x0 + x - gut, 0, l->w - 1)];
+    }
+    SDL_Texture *tex = SDL_CreateTexture(r, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, tw, th);
+    if (tex) SDL_UpdateTexture(tex, NULL, buf, tw * 4);
+    free(buf);
+    return tex;
+}
+
+// Destroys the least recently drawn textures of a view until it is back under MAP_TILE_BUDGET.
+// Tiles drawn this frame are never evicted, so a huge window only goes over budget, not blank.
+static void map_tiles_evict(int view) {
+    const size_t tile_bytes = (size_t)(MAP_TILE_SIZE + 2*MAP_TILE_GUTTER) * (MAP_TILE_SIZE + 2*MAP_TILE_GUTTER) * 4;
+    MapTile **res = g.map_resident[view];
+    while ((size_t)g.map_resident_count[view] * tile_bytes > MAP_TILE_BUDGET) {
+        int oldest = -1;
+        for (int i = 0; i < g.map_resident_count[view]; i++) {
+            if (res[i]->last_used[view] == g.map_frame[view]) continue;
+            if (oldest < 0 || res[i]->last_used[view] < res[oldest]->last_used[view]) oldest = i;
+        }
+        if (oldest < 0) break;
+        SDL_DestroyTexture(res[oldest]->tex[view]);
+        res[oldest]->tex[view] = NULL;
+        res[oldest] = res[--g.map_resident_count[view]];
+    }
+}
+
+// Draws the tiles of the level matching the zoom (one map texel per screen pixel or finer) that
+// intersect the window. Runs on the view's render thread, which owns that view's tile textures.
+static void map_tiles_draw(SDL_Renderer *r, MapTiles *mt, const Camera *c, int win_w, int win_h, int view) {
+    g.map_frame[view]++;
+    int level = c->zoom < 1.0f ? (int)floorf(log2f(1.0f / c->zoom)) : 0;
+    level = SDL_clamp(level, 0, mt->level_count - 1);
+    MapLevel *l = &mt->levels[level];
+    float scale = (float)(1 << level);  // Map pixels per texel of this level
+    float ts = MAP_TILE_SIZE * scale;   // Map pixels per tile
+    
+    int tx0 = SDL_max(0, (int)floorf(c->x / ts));
+    int ty0 = SDL_max(0, (int)floorf(c->y / ts));
+    int tx1 = SDL_min(l->tiles_x - 1, (int)floorf((c->x + win_w / c->zoom) / ts));
+    int ty1 = SDL_min(l->tiles_y - 1, (int)floorf((c->y + win_h / c->zoom) / ts));
+    for (int ty = ty0; ty <= ty1; ty++) {
+        for (int tx = tx0; tx <= tx1; tx++) {
+            MapTile *t = &l->tiles[ty * l->tiles_x + tx];
+            if (!t->tex[view]) {
+                int n = g.map_resident_count[view];
+                if (n == g.map_resident_cap[view]) {
+                    int cap = n ? n * 2 : 64;
+                    MapTile **res = realloc(g.map_resident[view], cap * sizeof(MapTile*));
+                    if (!res) continue;
+                    g.map_resident[view] = res;
+                    g.map_resident_cap[view] = cap;
+                }
+                t->tex[view] = map_tile_upload(r, l, tx, ty);
+                if (!t->tex[view]) continue;
+                g.map_resident[view][g.map_resident_count[view]++] = t;
+            }
+            t->last_used[view] = g.map_frame[view];
+            int tw = SDL_min(MAP_TILE_SIZE, l->w - tx * MAP_TILE_SIZE);
+            int th = SDL_min(MAP_TILE_SIZE, l->h - ty * MAP_TILE_SIZE);
+            SDL_FRect src = {MAP_TILE_GUTTER, MAP_TILE_GUTTER, tw, th};
+            SDL_FRect dst = {(tx * ts - c->x) * c->zoom, (ty * ts - c->y) * c->zoom, tw * scale * c->zoom, th * scale * c->zoom};
+            SDL_RenderTexture(r, t->tex[view], &src, &dst);
+        }
+    }
+    map_tiles_evict(view);
+}
+
+// Frees a decoded map and the tile textures of both views; asset_request builds it again, usually
+// from the pixel cache, once the source reference is dropped here. Main thread.
+static void map_unload(Asset *slot) {
+    MapTiles *mt = slot->tiles;
+    SDL_LockMutex(player_rt.lock);  // The player thread may still be drawing an older scene with this map
+    for (int view = 0; view < 2; view++) {
+        for (int i = 0; i < mt->level_count; i++) {
+            MapLevel *l = &mt->levels[i];
+            for (int k = 0; k < l->tiles_x * l->tiles_y; k++) {
+                if (!l->tiles[k].tex[view]) continue;
+                SDL_DestroyTexture(l->tiles[k].tex[view]);
+                l->tiles[k].tex[view] = NULL;
+            }
+        }
+        MapTile **res = g.map_resident[view];
+        for (int i = 0; i < g.map_resident_count[view]; ) {
+            if (res[i]->tex[view]) i++;
+            else res[i] = res[--g.map_resident_count[view]];
+        }
+    }
+    slot->tiles = NULL;
+    slot->loaded = slot->queued = false;
+    SDL_UnlockMutex(player_rt.lock);
+    map_tiles_free(mt);
+}
+
+static bool map_is_near(int i) {  // The current map or one M / Shift+M switches to
+    int n = g.map_count;
+    return i == g.map_current || i == (g.map_current + 1) % n || i == (g.map_current - 1 + n) % n;
+}
+
+// Unloads maps other than the current one and its neighbours, least recently near first, while
+// all decoded maps take more than MAP_PYRAMID_BUDGET
+static void map_pyramids_trim(void) {
+    uint64_t now = SDL_GetTicks();
+    size_t total = 0;
+    for (int i = 0; i < g.map_count; i++) {
+        MapTiles *mt = g.map_assets[i].tiles;
+        if (!mt) continue;
+        total += mt->bytes;
+        if (map_is_near(i)) mt->last_near = now;
+    }
+    while (total > MAP_PYRAMID_BUDGET) {
+        int oldest = -1;
+        for (int i = 0; i < g.map_count; i++) {
+            MapTiles *mt = g.map_assets[i].tiles;
+            if (!mt || map_is_near(i)) continue;
+            if (oldest < 0 || mt->last_near < g.map_assets[oldest].tiles->last_near) oldest = i;
+        }
+        if (oldest < 0) break;
+        total -= g.map_assets[oldest].tiles->bytes;
+        map_unload(&g.map_assets[oldest]);
+    }
+}
+
+// Creates the textures for a cached decode. Maps take their own reference for their tiles; the
+// caller keeps (and releases) its reference either way.
+static int load_asset_from_pixels(PixelEntry *p, Asset *slot, const char *name) {
     strncpy(slot->path, name, 255);
     slot->path[255] = '\0';
-    slot->w = w; slot->h = h;
-    SDL_Surface *s = SDL_CreateSurfaceFrom(w, h, SDL_PIXELFORMAT_RGBA32, pixels, w*4);
+    slot->w = p->w; slot->h = p->h;
+    if (asset_is_map(slot)) {
+        pixel_cache_retain(p);
+        slot->tiles = map_tiles_build(p);
+        slot->loaded = slot->tiles != NULL;
+        return slot->loaded ? 0 : -1;
+    }
+    SDL_Surface *s = SDL_CreateSurfaceFrom(p->w, p->h, SDL_PIXELFORMAT_RGBA32, p->pixels, p->w*4);
     if (s) {
         slot->tex[0] = SDL_CreateTextureFromSurface(g.dm.ren, s);
+        SDL_LockMutex(player_rt.lock);
         slot->tex[1] = SDL_CreateTextureFromSurface(g.player.ren, s);
+        SDL_UnlockMutex(player_rt.lock);
         SDL_DestroySurface(s);
     }
     slot->loaded = (slot->tex[0] && slot->tex[1]);
@@ -336,68 +1343,552 @@ static int load_asset_from_pixels(unsigned char *pixels, int w, int h, Asset *sl
 }
 
 static int load_asset_to_both(const char *path, Asset *slot) {
-    int w, h;
-    unsigned char *pixels = stbi_load(path, &w, &h, NULL, 4);
-    if (!pixels) return -1;
-    int result = load_asset_from_pixels(pixels, w, h, slot, path);
-    stbi_image_free(pixels);
+    PixelEntry *p = pixel_cache_load(path);
+    if (!p) return -1;
+    int result = load_asset_from_pixels(p, slot, path);
+    pixel_cache_release(p);
     return result;
 }
 
 static int load_asset_from_memory(unsigned char *data, int data_len, Asset *slot, const char *name) {
-    int w, h;
-    unsigned char *pixels = stbi_load_from_memory(data, data_len, &w, &h, NULL, 4);
-    if (!pixels) return -1;
-    int result = load_asset_from_pixels(pixels, w, h, slot, name);
-    stbi_image_free(pixels);
+    PixelEntry *p = pixel_cache_load_memory(name, data, data_len);
+    if (!p) return -1;
+    int result = load_asset_from_pixels(p, slot, name);
+    pixel_cache_release(p);
     return result;
 }
 
-static void ensure_asset_loaded(Asset *slot) {
-    if (!slot->loaded && slot->path[0]) {
-        load_asset_to_both(slot->path, slot);
+// Background image decoding: worker threads fill the pixel cache, the main thread creates the
+// textures when the finished decodes are collected (see asset_jobs_finish)
+#define ASSET_JOB_MAX 64
+#define ASSET_WORKERS_MAX 4
+
+typedef struct {
+    Asset *slot;
+    char path[256];
+    const unsigned char *blob;  // Compressed bytes from a save, decoded instead of the file at path
+    int blob_len;
+    PixelEntry *pixels;  // Cache reference, NULL on failure
+    MapTiles *tiles;     // Built on the worker for maps, which hands over the reference
+    bool urgent;
+} AssetJob;
+
+static struct {
+    SDL_Mutex *lock;
+    SDL_Condition *wake;
+    AssetJob pending[ASSET_JOB_MAX];  // Urgent requests at the front, prefetches at the back
+    int pending_count, busy_count;
+    AssetJob done[ASSET_JOB_MAX];
+    int done_count;
+    uint32_t event;                   // Pushed when a decode finishes so the event loop wakes up
+} asset_jobs;
+
+static int asset_worker(void *data) {
+    (void)data;
+    SDL_LockMutex(asset_jobs.lock);
+    while (1) {
+        while (asset_jobs.pending_count == 0) SDL_WaitCondition(asset_jobs.wake, asset_jobs.lock);
+        AssetJob job = asset_jobs.pending[0];
+        memmove(&asset_jobs.pending[0], &asset_jobs.pending[1], --asset_jobs.pending_count * sizeof(AssetJob));
+        asset_jobs.busy_count++;
+        SDL_UnlockMutex(asset_jobs.lock);
+        
+        job.pixels = job.blob ? pixel_cache_load_memory(job.path, job.blob, job.blob_len) : pixel_cache_load(job.path);
+        if (job.pixels && asset_is_map(job.slot)) {
+            job.tiles = map_tiles_build(job.pixels);
+            job.pixels = NULL;
+        }
+        
+        SDL_LockMutex(asset_jobs.lock);
+        asset_jobs.busy_count--;
+        asset_jobs.done[asset_jobs.done_count++] = job;
+        SDL_Event e = {0};
+        e.type = asset_jobs.event;
+        SDL_PushEvent(&e);
     }
+    return 0;
 }
 
-static int find_or_load_token_image(const char *path) {
-    for (int i = 0; i < g.token_lib_count; i++)
-        if (!strcmp(g.token_lib[i].path, path)) return i;
-    if (g.token_lib_count >= MAX_ASSETS) return -1;
-    if (load_asset_to_both(path, &g.token_lib[g.token_lib_count]) == 0)
-        return g.token_lib_count++;
-    return -1;
+// Workers run detached; one blocked in a decode at exit simply ends with the process
+static void asset_workers_start(void) {
+    asset_jobs.lock = SDL_CreateMutex();
+    asset_jobs.wake = SDL_CreateCondition();
+    asset_jobs.event = SDL_RegisterEvents(1);
+    if (!asset_jobs.lock || !asset_jobs.wake || !asset_jobs.event) return;
+    // Leave a core each for the main and player render threads
+    int n = SDL_GetNumLogicalCPUCores() - 2;
+    if (n < 1) n = 1;
+    if (n > ASSET_WORKERS_MAX) n = ASSET_WORKERS_MAX;
+    for (int i = 0; i < n; i++) {
+        SDL_Thread *t = SDL_CreateThread(asset_worker, "asset_decode", NULL);
+        if (t) SDL_DetachThread(t);
+    }
+}
+
+// Queues a decode for slot unless it is loaded or already queued. Urgent requests (the asset is
+// needed on screen now) go ahead of prefetches, and promote a matching prefetch. With the queue
+// full, an urgent request takes the place of the prefetch queued last.
+static void asset_request(Asset *slot, bool urgent) {
+    if (slot->loaded || !slot->path[0]) return;
+    if (!asset_jobs.event) {  // No workers: decode here
+        if (!slot->queued && slot->blob) load_asset_from_memory(slot->blob, slot->blob_len, slot, slot->path);
+        else if (!slot->queued) load_asset_to_both(slot->path, slot);
+        slot->queued = true;
+        return;
+    }
+    SDL_LockMutex(asset_jobs.lock);
+    AssetJob *q = asset_jobs.pending;
+    if (slot->queued) {
+        for (int i = 0; urgent && i < asset_jobs.pending_count; i++) {
+            if (q[i].slot != slot) continue;
+            AssetJob job = q[i];
+            memmove(&q[1], &q[0], i * sizeof(AssetJob));
+            q[0] = job;
+            q[0].urgent = true;
+            break;
+        }
+    } else {
+        int used = asset_jobs.pending_count + asset_jobs.busy_count + asset_jobs.done_count;
+        if (used >= ASSET_JOB_MAX && urgent && asset_jobs.pending_count && !q[asset_jobs.pending_count - 1].urgent) {
+            q[--asset_jobs.pending_count].slot->queued = false;  // Requested again by a later capture
+            used--;
+        }
+        if (used < ASSET_JOB_MAX) {
+            AssetJob job = {slot, "", slot->blob, slot->blob_len, NULL, NULL, urgent};
+            memcpy(job.path, slot->path, sizeof(job.path));
+            if (urgent) {
+                memmove(&q[1], &q[0], asset_jobs.pending_count * sizeof(AssetJob));
+                q[0] = job;
+            } else {
+                q[asset_jobs.pending_count] = job;
+            }
+            asset_jobs.pending_count++;
+            slot->queued = true;
+            SDL_SignalCondition(asset_jobs.wake);
+        }
+    }
+    SDL_UnlockMutex(asset_jobs.lock);
+}
+
+// Creates textures for finished decodes; runs on the main thread when the decode event arrives
+static void asset_jobs_finish(void) {
+    AssetJob done[ASSET_JOB_MAX];
+    SDL_LockMutex(asset_jobs.lock);
+    int n = asset_jobs.done_count;
+    memcpy(done, asset_jobs.done, n * sizeof(AssetJob));
+    asset_jobs.done_count = 0;
+    SDL_UnlockMutex(asset_jobs.lock);
+    
+    for (int i = 0; i < n; i++) {
+        AssetJob *job = &done[i];
+        if (!job->pixels && !job->tiles) {
+            printf("Failed to decode %s\n", job->path);  // Stays queued so it is not retried every frame
+            continue;
+        }
+        if (job->tiles) {
+            if (!job->slot->loaded) {
+                job->slot->tiles = job->tiles;
+                job->slot->w = job->tiles->source->w; job->slot->h = job->tiles->source->h;
+                job->slot->loaded = true;
+            } else {
+                map_tiles_free(job->tiles);
+            }
+        } else {
+            if (!job->slot->loaded) load_asset_from_pixels(job->pixels, job->slot, job->path);
+            pixel_cache_release(job->pixels);
+        }
+        if (job->slot == &g.map_assets[g.map_current]) {
+            g.map_w = job->slot->w;
+            g.map_h = job->slot->h;
+        }
+    }
+    map_pyramids_trim();
+}
+
+// Decodes the current map first, then the maps M and Shift+M would switch to, and unloads maps
+// further away once over budget
+static void map_prefetch(void) {
+    if (g.map_count <= 0) return;
+    asset_request(&g.map_assets[g.map_current], true);
+    asset_request(&g.map_assets[(g.map_current + 1) % g.map_count], false);
+    asset_request(&g.map_assets[(g.map_current - 1 + g.map_count) % g.map_count], false);
+    map_pyramids_trim();
+}
+
+static inline uint64_t fog_span_mask(int b0, int b1) {  // Bits [b0, b1) of a word, 0 <= b0 < b1 <= 64
+    uint64_t hi = (b1 == 64) ? ~0ull : ((1ull << b1) - 1);
+    return hi & ~((1ull << b0) - 1);
+}
+
+static inline uint64_t *fog_row(const FogGrid *f, int y) {
+    return f->bits + (size_t)y * f->stride;
+}
+
+static inline bool fog_grid_get(const FogGrid *f, int x, int y) {
+    return (x >= 0 && x < f->w && y >= 0 && y < f->h) ? (fog_row(f, y)[x >> 6] >> (x & 63)) & 1 : false;
+}
+
+static void dirty_rect_add(DirtyRect *d, int x0, int y0, int x1, int y1) {
+    if (d->x0 >= d->x1 || d->y0 >= d->y1) {
+        *d = (DirtyRect){x0, y0, x1, y1};
+        return;
+    }
+    if (x0 < d->x0) d->x0 = x0;
+    if (y0 < d->y0) d->y0 = y0;
+    if (x1 > d->x1) d->x1 = x1;
+    if (y1 > d->y1) d->y1 = y1;
+}
+
+// Records changed cells [x0, x1) x [y0, y1) until each view takes them for its texture-based fog
+// backends and the autosave journal takes them
+static void fog_mark_dirty(int x0, int y0, int x1, int y1) {
+    g.fog.version++;
+    for (int v = 0; v < 2; v++) dirty_rect_add(&g.fog_changed[v], x0, y0, x1, y1);
+    dirty_rect_add(&g.fog_journal, x0, y0, x1, y1);
+}
+
+// Sets cells [x0, x1) of row y with masked word writes; caller clips to the grid
+static void fog_fill_row(int y, int x0, int x1, bool v) {
+    if (x0 >= x1) return;
+    fog_mark_dirty(x0, y, x1, y + 1);
+    uint64_t *row = fog_row(&g.fog, y);
+    int w0 = x0 >> 6, w1 = (x1 - 1) >> 6;
+    for (int w = w0; w <= w1; w++) {
+        int b0 = (w == w0) ? (x0 & 63) : 0;
+        int b1 = (w == w1) ? ((x1 - 1) & 63) + 1 : 64;
+        uint64_t m = fog_span_mask(b0, b1);
+        if (v) row[w] |= m; else row[w] &= ~m;
+    }
+}
+
+// Sets cells in [x0, x1) x [y0, y1), clipped to the grid
+static void fog_fill_rect(int x0, int y0, int x1, int y1, bool v) {
+    if (!g.fog.bits) return;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > g.fog.w) x1 = g.fog.w;
+    if (y1 > g.fog.h) y1 = g.fog.h;
+    for (int y = y0; y < y1; y++) fog_fill_row(y, x0, x1, v);
 }
 
 static void fog_init(int w, int h) {
-    g.fog = realloc(g.fog, w * h);
-    if (g.fog) {
-        memset(g.fog, 1, w * h);
-        g.fog_w = w; g.fog_h = h;
+    int stride = (w + 63) / 64;
+    uint64_t *bits = realloc(g.fog.bits, (size_t)stride * h * sizeof(uint64_t));
+    if (bits) {
+        g.fog.bits = bits;
+        memset(bits, 0, (size_t)stride * h * sizeof(uint64_t));  // Keeps padding bits clear
+        g.fog.w = w; g.fog.h = h; g.fog.stride = stride;
+        fog_mark_dirty(0, 0, w, h);
+        fog_fill_rect(0, 0, w, h, true);
     }
 }
 
 static inline bool fog_get(int x, int y) {
-    return (x >= 0 && x < g.fog_w && y >= 0 && y < g.fog_h) ? g.fog[y*g.fog_w+x] : false;
+    return fog_grid_get(&g.fog, x, y);
 }
 
 static inline void fog_set(int x, int y, bool v) {
-    if (x >= 0 && x < g.fog_w && y >= 0 && y < g.fog_h) g.fog[y*g.fog_w+x] = v;
+    if (x >= 0 && x < g.fog.w && y >= 0 && y < g.fog.h) fog_fill_row(y, x, x + 1, v);
 }
 
 static void fog_paint_brush(int cx, int cy, bool v, int brush_size) {
     // Paint in a square brush area
     int radius = brush_size / 2;
-    for (int dy = -radius; dy <= radius; dy++) {
-        for (int dx = -radius; dx <= radius; dx++) {
-            fog_set(cx + dx, cy + dy, v);
+    fog_fill_rect(cx - radius, cy - radius, cx + radius + 1, cy + radius + 1, v);
+}
+
+static int fog_revealed_count(void) {
+    int n = 0;
+    for (size_t i = 0; i < (size_t)g.fog.stride * g.fog.h; i++) n += __builtin_popcountll(g.fog.bits[i]);
+    return n;
+}
+
+// First column >= x in row y whose cell is not v (f->w if the run reaches the edge)
+static int fog_scan_right(const FogGrid *f, int y, int x, bool v) {
+    const uint64_t *row = fog_row(f, y);
+    while (x < f->w) {
+        uint64_t word = v ? ~row[x >> 6] : row[x >> 6];  // Set bits mark cells != v
+        word &= ~0ull << (x & 63);
+        if (word) {
+            int e = (x & ~63) + __builtin_ctzll(word);
+            return e < f->w ? e : f->w;
+        }
+        x = (x & ~63) + 64;
+    }
+    return f->w;
+}
+
+// Leftmost column such that every cell from it through x in row y is v
+static int fog_scan_left(const FogGrid *f, int y, int x, bool v) {
+    const uint64_t *row = fog_row(f, y);
+    while (x >= 0) {
+        uint64_t word = v ? ~row[x >> 6] : row[x >> 6];
+        word &= fog_span_mask(0, (x & 63) + 1);
+        if (word) return (x & ~63) + 64 - __builtin_clzll(word);
+        x = (x & ~63) - 1;
+    }
+    return 0;
+}
+
+// Scanline flood: sets the 4-connected region of cells sharing (cx, cy)'s state to v
+static void fog_flood(int cx, int cy, bool v) {
+    if (!g.fog.bits || cx < 0 || cx >= g.fog.w || cy < 0 || cy >= g.fog.h) return;
+    bool target = fog_get(cx, cy);
+    if (target == v) return;
+    
+    int cap = 256, count = 0;
+    int *stack = malloc(cap * 2 * sizeof(int));
+    if (!stack) return;
+    stack[count*2] = cx; stack[count*2+1] = cy; count++;
+    
+    while (count > 0) {
+        count--;
+        int x = stack[count*2], y = stack[count*2+1];
+        if (fog_get(x, y) != target) continue;
+        int l = fog_scan_left(&g.fog, y, x, target);
+        int r = fog_scan_right(&g.fog, y, x, target);
+        fog_fill_row(y, l, r, v);
+        
+        // Seed one cell per matching span in the rows above and below
+        for (int ny = y - 1; ny <= y + 1; ny += 2) {
+            if (ny < 0 || ny >= g.fog.h) continue;
+            int sx = l;
+            while (sx < r) {
+                sx = fog_scan_right(&g.fog, ny, sx, !target);
+                if (sx >= r) break;
+                if (count == cap) {
+                    int *grown = realloc(stack, cap * 4 * sizeof(int));
+                    if (!grown) { free(stack); return; }
+                    stack = grown; cap *= 2;
+                }
+                stack[count*2] = sx; stack[count*2+1] = ny; count++;
+                sx = fog_scan_right(&g.fog, ny, sx, target);
+            }
+        }
+    }
+    free(stack);
+}
+
+static void fog_runs_push(FogRuns *fr, int x, int y, int w) {
+    if (fr->count == fr->cap) {
+        int cap = fr->cap ? fr->cap * 2 : 256;
+        SDL_FRect *cells = realloc(fr->cells, cap * sizeof(SDL_FRect));
+        if (!cells) return;
+        fr->cells = cells;
+        SDL_FRect *screen = realloc(fr->screen, cap * sizeof(SDL_FRect));
+        if (!screen) return;
+        fr->screen = screen;
+        fr->cap = cap;
+    }
+    fr->cells[fr->count++] = (SDL_FRect){(float)x, (float)y, (float)w, 1};
+}
+
+// Rebuilds hidden-cell rectangles for cells [sc, ec) x [sr, er) when the fog or the range changed.
+// Each row is split into hidden runs; a run with the same extent as one in the row above grows that rect.
+static void fog_runs_update(FogRuns *fr, const FogGrid *f, int sc, int sr, int ec, int er) {
+    if (fr->valid && fr->fog_version == f->version &&
+        fr->sc == sc && fr->sr == sr && fr->ec == ec && fr->er == er) return;
+    fr->valid = true;
+    fr->fog_version = f->version;
+    fr->sc = sc; fr->sr = sr; fr->ec = ec; fr->er = er;
+    fr->count = 0;
+    if (!f->bits || ec <= sc) return;
+    
+    // Indices of rects ending on the previous / current row, sorted by x
+    int max_open = (ec - sc + 1) / 2;
+    if (fr->open_cap < max_open) {
+        int *open = realloc(fr->open, 2 * max_open * sizeof(int));
+        if (!open) return;
+        fr->open = open;
+        fr->open_cap = max_open;
+    }
+    int *prev = fr->open, *cur = fr->open + fr->open_cap;
+    int prev_n = 0;
+    
+    for (int y = sr; y < er; y++) {
+        int cur_n = 0, p = 0;
+        int x = sc;
+        while (x < ec) {
+            x = fog_scan_right(f, y, x, true);       // First hidden cell
+            if (x >= ec) break;
+            int e = fog_scan_right(f, y, x, false);  // First revealed cell after it
+            if (e > ec) e = ec;
+            
+            while (p < prev_n && fr->cells[prev[p]].x < x) p++;
+            if (p < prev_n && fr->cells[prev[p]].x == x && fr->cells[prev[p]].w == e - x) {
+                fr->cells[prev[p]].h += 1;
+                cur[cur_n++] = prev[p];
+            } else {
+                int before = fr->count;
+                fog_runs_push(fr, x, y, e - x);
+                if (fr->count > before) cur[cur_n++] = before;
+            }
+            x = e;
+        }
+        int *t = prev; prev = cur; cur = t;
+        prev_n = cur_n;
+    }
+}
+
+// Recreates the mask texture on resize and uploads the rows touched since the last frame
+static void fog_mask_update(FogMask *m, SDL_Renderer *r, const FogGrid *f, int view) {
+    if (!f->bits || f->w <= 0 || f->h <= 0) return;
+    if (!m->tex || m->w != f->w || m->h != f->h) {
+        if (m->tex) SDL_DestroyTexture(m->tex);
+        m->tex = SDL_CreateTexture(r, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, f->w, f->h);
+        if (!m->tex) return;
+        SDL_SetTextureBlendMode(m->tex, SDL_BLENDMODE_BLEND);
+        SDL_SetTextureScaleMode(m->tex, SDL_SCALEMODE_NEAREST);
+        uint8_t *rows = realloc(m->rows, (size_t)f->w * f->h * 4);
+        if (!rows) return;
+        m->rows = rows;
+        m->w = f->w; m->h = f->h;
+        m->dirty = (DirtyRect){0, 0, f->w, f->h};
+    }
+    if (m->dirty.x0 >= m->dirty.x1 || m->dirty.y0 >= m->dirty.y1) return;
+    
+    int y0 = m->dirty.y0 < 0 ? 0 : m->dirty.y0;
+    int y1 = m->dirty.y1 > m->h ? m->h : m->dirty.y1;
+    uint8_t hidden = view == 0 ? 180 : 255;
+    for (int y = y0; y < y1; y++) {
+        uint8_t *p = m->rows + (size_t)y * m->w * 4;
+        const uint64_t *row = fog_row(f, y);
+        for (int x = 0; x < m->w; x++, p += 4) {
+            p[0] = p[1] = p[2] = 0;
+            p[3] = ((row[x >> 6] >> (x & 63)) & 1) ? 0 : hidden;
         }
     }
+    if (y1 > y0)
+        SDL_UpdateTexture(m->tex, &(SDL_Rect){0, y0, m->w, y1 - y0}, m->rows + (size_t)y0 * m->w * 4, m->w * 4);
+    m->dirty = (DirtyRect){0, 0, 0, 0};
+}
+
+// Reallocates the soft mask when the fog grid size changed; returns false if unavailable
+static bool soft_fog_resize(SoftFog *sf, const FogGrid *f) {
+    if (!f->bits || f->w <= 0 || f->h <= 0) return false;
+    if (sf->alpha && sf->grid_w == f->w && sf->grid_h == f->h) return true;
+    
+    int longest = f->w > f->h ? f->w : f->h;
+    sf->scale = SOFT_FOG_MAX_TEXELS / longest;
+    if (sf->scale > SOFT_FOG_MAX_SCALE) sf->scale = SOFT_FOG_MAX_SCALE;
+    if (sf->scale < 1) sf->scale = 1;
+    sf->w = f->w * sf->scale;
+    sf->h = f->h * sf->scale;
+    sf->grid_w = f->w; sf->grid_h = f->h;
+    
+    size_t pw = sf->w + 2*SOFT_FOG_RADIUS, ph = sf->h + 2*SOFT_FOG_RADIUS;
+    free(sf->src); free(sf->tmp); free(sf->acc); free(sf->alpha); free(sf->rgba);
+    sf->src = malloc(pw * ph);
+    sf->tmp = malloc(sf->w * ph * sizeof(uint16_t));
+    sf->acc = malloc(sf->w * sizeof(uint16_t));
+    sf->alpha = malloc((size_t)sf->w * sf->h);
+    sf->rgba = malloc((size_t)sf->w * sf->h * 4);
+    if (sf->tex) SDL_DestroyTexture(sf->tex);
+    sf->tex = NULL;
+    if (!sf->src || !sf->tmp || !sf->acc || !sf->alpha || !sf->rgba) {
+        free(sf->alpha);
+        sf->alpha = NULL;
+        return false;
+    }
+    sf->dirty = (DirtyRect){0, 0, f->w, f->h};
+    return true;
 }
 
-static void cam_update(Camera *c) {
-    c->x += (c->target_x - c->x) * 0.15f;
-    c->y += (c->target_y - c->y) * 0.15f;
-    c->zoom += (c->target_zoom - c->zoom) * 0.15f;
+// Re-blurs the texels affected by cells changed since the last call
+static void soft_fog_blur(SoftFog *sf, const FogGrid *f) {
+    if (sf->dirty.x0 >= sf->dirty.x1 || sf->dirty.y0 >= sf->dirty.y1) return;
+    const int R = SOFT_FOG_RADIUS, s = sf->scale;
+    const int pw = sf->w + 2*R;
+    
+    // Changed texels and the blurred texels they reach
+    int tx0 = sf->dirty.x0 * s, ty0 = sf->dirty.y0 * s;
+    int tx1 = sf->dirty.x1 * s, ty1 = sf->dirty.y1 * s;
+    if (tx0 < 0) tx0 = 0;
+    if (ty0 < 0) ty0 = 0;
+    if (tx1 > sf->w) tx1 = sf->w;
+    if (ty1 > sf->h) ty1 = sf->h;
+    int ox0 = tx0 - R < 0 ? 0 : tx0 - R, oy0 = ty0 - R < 0 ? 0 : ty0 - R;
+    int ox1 = tx1 + R > sf->w ? sf->w : tx1 + R, oy1 = ty1 + R > sf->h ? sf->h : ty1 + R;
+    
+    // Hard mask with clamp-to-edge padding; src row py holds texel row py - R
+    int sx0 = tx0 - R, sy0 = ty0 - R, sx1 = tx1 + R, sy1 = ty1 + R;
+    for (int y = sy0; y < sy1; y++) {
+        int cy = (y < 0 ? 0 : y >= sf->h ? sf->h - 1 : y) / s;
+        const uint64_t *row = fog_row(f, cy);
+        uint8_t *dst = sf->src + (size_t)(y + R) * pw + R;
+        for (int x = sx0; x < sx1; x++) {
+            int cx = (x < 0 ? 0 : x >= sf->w ? sf->w - 1 : x) / s;
+            dst[x] = ((row[cx >> 6] >> (cx & 63)) & 1) ? 0 : 255;
+        }
+    }
+    
+    // Horizontal pass: sum of shifted rows, contiguous in x so the inner loop vectorizes
+    int n = ox1 - ox0;
+    for (int y = oy0 - R; y < oy1 + R; y++) {
+        uint16_t *t = sf->tmp + (size_t)(y + R) * sf->w + ox0;
+        const uint8_t *src = sf->src + (size_t)(y + R) * pw + R + ox0;
+        for (int x = 0; x < n; x++) t[x] = 0;
+        for (int k = -R; k <= R; k++)
+            for (int x = 0; x < n; x++) t[x] += src[x + k];
+    }
+    
+    // Vertical pass: same row kernel over the horizontal sums
+    for (int y = oy0; y < oy1; y++) {
+        uint16_t *acc = sf->acc;
+        for (int x = 0; x < n; x++) acc[x] = 0;
+        for (int k = -R; k <= R; k++) {
+            const uint16_t *t = sf->tmp + (size_t)(y + k + R) * sf->w + ox0;
+            for (int x = 0; x < n; x++) acc[x] += t[x];
+        }
+        uint8_t *a = sf->alpha + (size_t)y * sf->w + ox0;
+        for (int x = 0; x < n; x++) a[x] = (uint8_t)(((uint32_t)acc[x] * SOFT_FOG_NORM) >> 16);
+    }
+    
+    dirty_rect_add(&sf->upload, ox0, oy0, ox1, oy1);
+    sf->dirty = (DirtyRect){0, 0, 0, 0};
+}
+
+// Uploads freshly blurred texels, tinted to the view's fog opacity
+static void soft_fog_upload(SoftFog *sf, SDL_Renderer *r, int view) {
+    if (!sf->tex) {
+        sf->tex = SDL_CreateTexture(r, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, sf->w, sf->h);
+        if (!sf->tex) return;
+        SDL_SetTextureBlendMode(sf->tex, SDL_BLENDMODE_BLEND);
+        SDL_SetTextureScaleMode(sf->tex, SDL_SCALEMODE_LINEAR);
+        sf->upload = (DirtyRect){0, 0, sf->w, sf->h};
+    }
+    DirtyRect *u = &sf->upload;
+    if (u->x0 >= u->x1 || u->y0 >= u->y1) return;
+    
+    uint32_t hidden = view == 0 ? 180 : 255;
+    int n = u->x1 - u->x0;
+    for (int y = u->y0; y < u->y1; y++) {
+        const uint8_t *a = sf->alpha + (size_t)y * sf->w + u->x0;
+        uint8_t *p = sf->rgba + ((size_t)y * sf->w + u->x0) * 4;
+        for (int x = 0; x < n; x++, p += 4) {
+            p[0] = p[1] = p[2] = 0;
+            p[3] = (uint8_t)(a[x] * hidden / 255);
+        }
+    }
+    SDL_UpdateTexture(sf->tex, &(SDL_Rect){u->x0, u->y0, n, u->y1 - u->y0},
+                      sf->rgba + ((size_t)u->y0 * sf->w + u->x0) * 4, sf->w * 4);
+    *u = (DirtyRect){0, 0, 0, 0};
+}
+
+// Eases toward the target, covering 15% of the distance per 60th of a second whatever the refresh
+// rate, and snaps once the step is a fraction of a screen pixel; returns true if it moved
+static bool cam_update(Camera *c, float dt_s) {
+    if (c->x == c->target_x && c->y == c->target_y && c->zoom == c->target_zoom) return false;
+    float k = 1.0f - powf(0.85f, fminf(dt_s, 0.1f) * 60.0f);  // Long stalls don't jump to the target
+    c->x += (c->target_x - c->x) * k;
+    c->y += (c->target_y - c->y) * k;
+    c->zoom += (c->target_zoom - c->zoom) * k;
+    float snap = k / 0.15f;  // Thresholds were tuned for 60 Hz steps
+    float px = c->target_zoom > 0 ? snap * 0.05f / c->target_zoom : 0.0f;
+    if (fabsf(c->target_x - c->x) < px) c->x = c->target_x;
+    if (fabsf(c->target_y - c->y) < px) c->y = c->target_y;
+    if (fabsf(c->target_zoom - c->zoom) < snap * c->target_zoom * 1e-4f) c->zoom = c->target_zoom;
+    return true;
 }
 
 static void cam_zoom(Camera *c, float mx, float my, float f) {
@@ -410,18 +1901,340 @@ static void cam_zoom(Camera *c, float mx, float my, float f) {
     c->target_y = wy - my / nz;
 }
 
-static void screen_to_grid(float sx, float sy, const Camera *c, int *gx, int *gy) {
-    int wx = (int)(sx / c->zoom + c->x);
-    int wy = (int)(sy / c->zoom + c->y);
-    *gx = (wx - g.grid_off_x) / g.grid_size;
-    *gy = (wy - g.grid_off_y) / g.grid_size;
+static void screen_to_grid(float sx, float sy, const Camera *c, int *gx, int *gy) {
+    int wx = (int)(sx / c->zoom + c->x);
+    int wy = (int)(sy / c->zoom + c->y);
+    *gx = (wx - g.grid_off_x) / g.grid_size;
+    *gy = (wy - g.grid_off_y) / g.grid_size;
+}
+
+static void pool_init(Pool *p, size_t item_size) {
+    memset(p, 0, sizeof(*p));
+    p->item_size = item_size;
+    p->head = p->tail = p->free = -1;
+}
+
+// Zeroed slot at the end of the drawing order, -1 when out of memory. Growing may move items.
+static int pool_alloc(Pool *p) {
+    if (p->free < 0) {
+        int cap = p->cap ? p->cap * 2 : 64;
+        void *items = realloc(p->items, cap * p->item_size);
+        if (!items) return -1;
+        p->items = items;
+        int *next = realloc(p->next, cap * sizeof(int));
+        if (!next) return -1;
+        p->next = next;
+        int *prev = realloc(p->prev, cap * sizeof(int));
+        if (!prev) return -1;
+        p->prev = prev;
+        uint32_t *seq = realloc(p->seq, cap * sizeof(uint32_t));
+        if (!seq) return -1;
+        p->seq = seq;
+        bool *live = realloc(p->live, cap * sizeof(bool));
+        if (!live) return -1;
+        p->live = live;
+        for (int k = p->cap; k < cap; k++) {
+            p->next[k] = k + 1 < cap ? k + 1 : -1;
+            p->live[k] = false;
+        }
+        p->free = p->cap;
+        p->cap = cap;
+    }
+    int i = p->free;
+    p->free = p->next[i];
+    memset((char *)p->items + (size_t)i * p->item_size, 0, p->item_size);
+    p->live[i] = true;
+    p->seq[i] = p->next_seq++;
+    p->prev[i] = p->tail;
+    p->next[i] = -1;
+    if (p->tail >= 0) p->next[p->tail] = i;
+    else p->head = i;
+    p->tail = i;
+    p->count++;
+    return i;
+}
+
+static void pool_free(Pool *p, int i) {
+    if (i < 0 || i >= p->cap || !p->live[i]) return;
+    if (p->prev[i] >= 0) p->next[p->prev[i]] = p->next[i];
+    else p->head = p->next[i];
+    if (p->next[i] >= 0) p->prev[p->next[i]] = p->prev[i];
+    else p->tail = p->prev[i];
+    p->live[i] = false;
+    p->next[i] = p->free;
+    p->free = i;
+    p->count--;
+}
+
+static inline bool pool_live(const Pool *p, int i) {
+    return i >= 0 && i < p->cap && p->live[i];
+}
+
+// Live items copied out in drawing order, into a buffer grown as needed. Returns the count.
+static int pool_pack(const Pool *p, void **buf, int *cap) {
+    if (p->count > *cap) {
+        void *grown = realloc(*buf, (size_t)p->count * p->item_size);
+        if (!grown) return 0;
+        *buf = grown;
+        *cap = p->count;
+    }
+    int n = 0;
+    POOL_FOR(*p, i) memcpy((char *)*buf + (size_t)n++ * p->item_size, (char *)p->items + (size_t)i * p->item_size, p->item_size);
+    return n;
+}
+
+// Cell -> token index. Each token is entered once per cell it covers (size x size from its anchor
+// cell, extending up and right as it is drawn), chained per hash bucket, keyed by token slot. The
+// token edits below keep it in step with g.tokens.
+#define TOKEN_HASH_BUCKETS 1024  // Power of two
+
+typedef struct {
+    int x, y, token;
+    int next;  // Next entry in the bucket or the free list, -1 at the end
+} TokenCell;
+
+static struct {
+    int head[TOKEN_HASH_BUCKETS];
+    TokenCell *cells;
+    int cap, free;
+    struct TokenPlaced { int x, y, size; } *placed;  // Footprint each token slot was entered with
+    int *seen;  // Query stamp per slot, so tokens covering several cells are listed once
+    int slot_cap;
+    int stamp;
+    int *hits;  // Query results
+    int hits_cap;
+} token_index;
+
+static inline int token_hash(int x, int y) {
+    return (int)(((uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u) & (TOKEN_HASH_BUCKETS - 1));
+}
+
+// Cells [x0, x0 + size) x [y0, y0 + size) covered by a token
+static inline void token_footprint(const Token *t, int *x0, int *y0) {
+    *x0 = t->grid_x;
+    *y0 = t->grid_y - (t->size - 1);
+}
+
+static void token_index_add(int i) {
+    if (i >= token_index.slot_cap) {
+        int cap = g.token_pool.cap;
+        struct TokenPlaced *placed = realloc(token_index.placed, cap * sizeof(*placed));
+        if (!placed) return;
+        token_index.placed = placed;
+        int *seen = realloc(token_index.seen, cap * sizeof(int));
+        if (!seen) return;
+        token_index.seen = seen;
+        for (int k = token_index.slot_cap; k < cap; k++) {
+            token_index.placed[k].size = 0;
+            token_index.seen[k] = 0;
+        }
+        token_index.slot_cap = cap;
+    }
+    const Token *t = &g.tokens[i];
+    int x0, y0, size = SDL_max(t->size, 1);
+    token_footprint(t, &x0, &y0);
+    token_index.placed[i].x = x0;
+    token_index.placed[i].y = y0;
+    token_index.placed[i].size = size;
+    for (int y = y0; y < y0 + size; y++) {
+        for (int x = x0; x < x0 + size; x++) {
+            if (token_index.free < 0) {
+                int cap = token_index.cap ? token_index.cap * 2 : 1024;
+                TokenCell *cells = realloc(token_index.cells, cap * sizeof(TokenCell));
+                if (!cells) return;
+                for (int k = token_index.cap; k < cap; k++) cells[k].next = k + 1 < cap ? k + 1 : -1;
+                token_index.cells = cells;
+                token_index.free = token_index.cap;
+                token_index.cap = cap;
+            }
+            int e = token_index.free, b = token_hash(x, y);
+            token_index.free = token_index.cells[e].next;
+            token_index.cells[e] = (TokenCell){x, y, i, token_index.head[b]};
+            token_index.head[b] = e;
+        }
+    }
+}
+
+static void token_index_remove(int i) {
+    if (i < 0 || i >= token_index.slot_cap) return;
+    int x0 = token_index.placed[i].x, y0 = token_index.placed[i].y, size = token_index.placed[i].size;
+    for (int y = y0; y < y0 + size; y++) {
+        for (int x = x0; x < x0 + size; x++) {
+            for (int *link = &token_index.head[token_hash(x, y)]; *link >= 0; ) {
+                TokenCell *c = &token_index.cells[*link];
+                if (c->token != i || c->x != x || c->y != y) {
+                    link = &c->next;
+                    continue;
+                }
+                int e = *link;
+                *link = c->next;
+                c->next = token_index.free;
+                token_index.free = e;
+                break;
+            }
+        }
+    }
+    token_index.placed[i].size = 0;
+}
+
+// After a token moved or changed size
+static void token_index_update(int i) {
+    token_index_remove(i);
+    token_index_add(i);
+}
+
+// After tokens were replaced wholesale (load, restore)
+static void token_index_rebuild(void) {
+    for (int b = 0; b < TOKEN_HASH_BUCKETS; b++) token_index.head[b] = -1;
+    token_index.free = token_index.cap ? 0 : -1;
+    for (int k = 0; k < token_index.cap; k++) token_index.cells[k].next = k + 1 < token_index.cap ? k + 1 : -1;
+    for (int k = 0; k < token_index.slot_cap; k++) token_index.placed[k].size = 0;
+    POOL_FOR(g.token_pool, i) token_index_add(i);
+}
+
+// Token slots covering any cell of [x0, x1) x [y0, y1), in drawing order. Cost is one bucket walk per
+// cell plus the tokens found, independent of the token count. The results stay valid until the next query.
+static int token_index_query(int x0, int y0, int x1, int y1, const int **out) {
+    const uint32_t *seq = g.token_pool.seq;
+    int n = 0, stamp = ++token_index.stamp;
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            for (int e = token_index.head[token_hash(x, y)]; e >= 0; e = token_index.cells[e].next) {
+                const TokenCell *c = &token_index.cells[e];
+                if (c->x != x || c->y != y || token_index.seen[c->token] == stamp) continue;
+                token_index.seen[c->token] = stamp;
+                if (n == token_index.hits_cap) {
+                    int cap = token_index.hits_cap ? token_index.hits_cap * 2 : 64;
+                    int *hits = realloc(token_index.hits, cap * sizeof(int));
+                    if (!hits) continue;
+                    token_index.hits = hits;
+                    token_index.hits_cap = cap;
+                }
+                int *hits = token_index.hits, k = n++;
+                for (; k > 0 && seq[hits[k - 1]] > seq[c->token]; k--) hits[k] = hits[k - 1];
+                hits[k] = c->token;
+            }
+        }
+    }
+    *out = token_index.hits;
+    return n;
+}
+
+// Topmost token covering a cell, -1 if none
+static int token_at(int x, int y) {
+    const int *hits;
+    int n = token_index_query(x, y, x + 1, y + 1, &hits);
+    return n > 0 ? hits[n - 1] : -1;
+}
+
+// Fields token_cull reads for every live token, per slot beside g.token_pool. Edits to any of them
+// call token_hot_update, so a capture reads full records only for the tokens the view draws.
+static struct {
+    int *cell_x, *cell_y;  // Anchor cell
+    int *size, *aura;
+    int *image;            // Token library index, for the sprite height
+    uint8_t *flags;        // TOKEN_HOT_*
+    int cap;
+} token_hot;
+
+#define TOKEN_HOT_HIDDEN 1
+#define TOKEN_HOT_MARKED 2    // Has damage or conditions to draw
+#define TOKEN_HOT_SELECTED 4
+
+// After a token was added or its cell, size, aura, image, visibility, damage, conditions or selection changed
+static void token_hot_update(int i) {
+    if (i >= token_hot.cap) {
+        int cap = g.token_pool.cap;
+        int *cell_x = realloc(token_hot.cell_x, cap * sizeof(int));
+        if (!cell_x) return;
+        token_hot.cell_x = cell_x;
+        int *cell_y = realloc(token_hot.cell_y, cap * sizeof(int));
+        if (!cell_y) return;
+        token_hot.cell_y = cell_y;
+        int *size = realloc(token_hot.size, cap * sizeof(int));
+        if (!size) return;
+        token_hot.size = size;
+        int *aura = realloc(token_hot.aura, cap * sizeof(int));
+        if (!aura) return;
+        token_hot.aura = aura;
+        int *image = realloc(token_hot.image, cap * sizeof(int));
+        if (!image) return;
+        token_hot.image = image;
+        uint8_t *flags = realloc(token_hot.flags, cap);
+        if (!flags) return;
+        token_hot.flags = flags;
+        token_hot.cap = cap;
+    }
+    const Token *t = &g.tokens[i];
+    bool marked = t->damage > 0;
+    for (int c = 0; c < COND_COUNT; c++) marked |= t->cond[c];
+    token_hot.cell_x[i] = t->grid_x;
+    token_hot.cell_y[i] = t->grid_y;
+    token_hot.size[i] = t->size;
+    token_hot.aura[i] = t->aura;
+    token_hot.image[i] = t->image_idx;
+    token_hot.flags[i] = (t->hidden ? TOKEN_HOT_HIDDEN : 0) | (marked ? TOKEN_HOT_MARKED : 0) |
+                         (t->selected ? TOKEN_HOT_SELECTED : 0);
+}
+
+// After tokens were replaced wholesale (load, restore)
+static void token_hot_rebuild(void) {
+    POOL_FOR(g.token_pool, i) token_hot_update(i);
+}
+
+// Token and drawing lifetimes. New items go on top of the drawing order; g.tokens and g.drawings
+// follow the pools as they grow.
+static int token_new(void) {
+    int i = pool_alloc(&g.token_pool);
+    g.tokens = g.token_pool.items;
+    return i;
+}
+
+static void token_delete(int i) {
+    if (!pool_live(&g.token_pool, i)) return;
+    token_index_remove(i);
+    pool_free(&g.token_pool, i);
+    if (g.drag_idx == i) {
+        g.drag_idx = -1;
+        g.drag_token = false;
+    }
+    if (g.cond_token_idx == i) {
+        g.cond_token_idx = -1;
+        g.cond_wheel = false;
+    }
+}
+
+static void tokens_clear(void) {
+    POOL_FOR(g.token_pool, i) token_delete(i);
+}
+
+static void tokens_deselect(void) {
+    POOL_FOR(g.token_pool, i) {
+        if (!g.tokens[i].selected) continue;
+        g.tokens[i].selected = false;
+        token_hot_update(i);
+    }
+}
+
+static int drawing_new(void) {
+    int i = pool_alloc(&g.drawing_pool);
+    g.drawings = g.drawing_pool.items;
+    return i;
+}
+
+static void drawing_delete(int i) {
+    pool_free(&g.drawing_pool, i);
+}
+
+static void drawings_clear(void) {
+    POOL_FOR(g.drawing_pool, i) drawing_delete(i);
 }
 
 static void render_circle(SDL_Renderer *r, float cx, float cy, float rad, bool fill, SDL_Color col) {
     SDL_SetRenderDrawColor(r, col.r, col.g, col.b, col.a);
     if (fill) {
         // Batch all horizontal lines into a single array
-        static SDL_FRect rects[2048];
+        SDL_FRect rects[2048];
         int rect_count = 0;
         int ir = (int)rad;
         float rad_sq = rad * rad;
@@ -439,7 +2252,7 @@ static void render_circle(SDL_Renderer *r, float cx, float cy, float rad, bool f
         }
     } else {
         // Batch all outline points into a single array
-        static SDL_FPoint points[2048];
+        SDL_FPoint points[2048];
         int point_count = 0;
         int x = 0, y = (int)rad, d = 3 - 2*(int)rad;
         
@@ -462,111 +2275,202 @@ static void render_circle(SDL_Renderer *r, float cx, float cy, float rad, bool f
     }
 }
 
-static void render_token(SDL_Renderer *r, Token *t, const Camera *c, int view) {
-    if (t->hidden && view == 1) return;
-    int gx = t->grid_x * g.grid_size + g.grid_off_x;
-    int gy = t->grid_y * g.grid_size + g.grid_off_y;
-    Asset *img = &g.token_lib[t->image_idx];
-    ensure_asset_loaded(img);
-    if (!img->tex[view]) return;
-    float scale = (g.grid_size * t->size) / (float)img->w * c->zoom;
-    float sw = img->w * scale, sh = img->h * scale;
-    float sx = (gx - c->x) * c->zoom;
-    float sy = (gy - c->y) * c->zoom - (sh - g.grid_size * c->zoom);
-    
-    if (t->squad >= 0) {
-        static const SDL_Color squad_cols[8] = {
-            {255,50,50,255},{50,150,255,255},{50,255,50,255},{255,255,50,255},
-            {255,150,50,255},{200,50,255,255},{50,255,255,255},{255,255,255,255}
-        };
-        SDL_Color col = squad_cols[t->squad % 8];
-        float thick = 3 * c->zoom;
-        SDL_SetRenderDrawColor(r, col.r, col.g, col.b, 255);
-        SDL_FRect rects[4] = {
-            {sx-thick, sy-thick, sw+2*thick, thick},
-            {sx-thick, sy+sh, sw+2*thick, thick},
-            {sx-thick, sy, thick, sh},
-            {sx+sw, sy, thick, sh}
-        };
-        SDL_RenderFillRects(r, rects, 4);
+static void quad_batch_add(QuadBatch *b, SDL_FRect q, SDL_FColor col, float u0, float v0, float u1, float v1) {
+    if (b->quads == b->cap) {
+        int cap = b->cap ? b->cap * 2 : 256;
+        SDL_Vertex *verts = realloc(b->verts, cap * 4 * sizeof(SDL_Vertex));
+        if (!verts) return;
+        b->verts = verts;
+        int *indices = realloc(b->indices, cap * 6 * sizeof(int));
+        if (!indices) return;
+        b->indices = indices;
+        b->cap = cap;
+    }
+    int n = b->quads++;
+    SDL_Vertex *v = &b->verts[n*4];
+    v[0] = (SDL_Vertex){{q.x, q.y}, col, {u0, v0}};
+    v[1] = (SDL_Vertex){{q.x + q.w, q.y}, col, {u1, v0}};
+    v[2] = (SDL_Vertex){{q.x + q.w, q.y + q.h}, col, {u1, v1}};
+    v[3] = (SDL_Vertex){{q.x, q.y + q.h}, col, {u0, v1}};
+    int *ix = &b->indices[n*6];
+    ix[0] = n*4; ix[1] = n*4+1; ix[2] = n*4+2;
+    ix[3] = n*4; ix[4] = n*4+2; ix[5] = n*4+3;
+}
+
+static inline void quad_batch_fill(QuadBatch *b, SDL_FRect q, SDL_FColor col) {
+    quad_batch_add(b, q, col, 0, 0, 0, 0);
+}
+
+// One pixel outline inside the rectangle, as SDL_RenderRect draws it
+static void quad_batch_outline(QuadBatch *b, SDL_FRect q, SDL_FColor col) {
+    quad_batch_fill(b, (SDL_FRect){q.x, q.y, q.w, 1}, col);
+    quad_batch_fill(b, (SDL_FRect){q.x, q.y + q.h - 1, q.w, 1}, col);
+    quad_batch_fill(b, (SDL_FRect){q.x, q.y + 1, 1, q.h - 2}, col);
+    quad_batch_fill(b, (SDL_FRect){q.x + q.w - 1, q.y + 1, 1, q.h - 2}, col);
+}
+
+// Submits the quads in one call and empties the batch. Untextured quads blend with the draw blend mode.
+static void quad_batch_draw(QuadBatch *b, SDL_Renderer *r, SDL_Texture *tex) {
+    if (b->quads > 0) SDL_RenderGeometry(r, tex, b->verts, b->quads * 4, b->indices, b->quads * 6);
+    b->quads = 0;
+}
+
+static inline SDL_FColor fcolor(SDL_Color c) {
+    return (SDL_FColor){c.r / 255.0f, c.g / 255.0f, c.b / 255.0f, c.a / 255.0f};
+}
+
+// Draws a run of tokens that do not overlap piece by piece across the run: squad borders, sprites
+// with one geometry call per image (opacity carried in the vertex colour, so no texture state changes
+// per token), selection boxes, rank letters.
+static void render_token_run(SDL_Renderer *r, const Scene *s, int view, const int *run, const SDL_FRect *rects, int n) {
+    static const SDL_Color squad_cols[8] = {
+        {255,50,50,255},{50,150,255,255},{50,255,50,255},{255,255,50,255},
+        {255,150,50,255},{200,50,255,255},{50,255,255,255},{255,255,255,255}
+    };
+    TokenBatch *b = &g.token_batch[view];
+    const Camera *c = &s->cam;
+    const Token *rec = s->tokens->rec;
+    float thick = 3 * c->zoom;
+    for (int p = 0; p < n; p++) {
+        const Token *t = &rec[run[p]];
+        if (t->squad < 0) continue;
+        SDL_FColor col = fcolor(squad_cols[t->squad % 8]);
+        SDL_FRect q = rects[p];
+        quad_batch_fill(&b->colors, (SDL_FRect){q.x-thick, q.y-thick, q.w+2*thick, thick}, col);
+        quad_batch_fill(&b->colors, (SDL_FRect){q.x-thick, q.y+q.h, q.w+2*thick, thick}, col);
+        quad_batch_fill(&b->colors, (SDL_FRect){q.x-thick, q.y, thick, q.h}, col);
+        quad_batch_fill(&b->colors, (SDL_FRect){q.x+q.w, q.y, thick, q.h}, col);
     }
+    quad_batch_draw(&b->colors, r, NULL);
     
-    SDL_SetTextureAlphaMod(img->tex[view], t->hidden ? 128 : t->opacity);
-    SDL_RenderTexture(r, img->tex[view], NULL, &(SDL_FRect){sx, sy, sw, sh});
-    SDL_SetTextureAlphaMod(img->tex[view], 255);
+    bool drawn[TOKEN_RUN_MAX] = {false};
+    for (int p = 0; p < n; p++) {
+        if (drawn[p]) continue;
+        int image_idx = rec[run[p]].image_idx;
+        for (int q = p; q < n; q++) {
+            const Token *t = &rec[run[q]];
+            if (drawn[q] || t->image_idx != image_idx) continue;
+            drawn[q] = true;
+            float a = (t->hidden ? 128 : t->opacity) / 255.0f;
+            quad_batch_add(&b->sprites, rects[q], (SDL_FColor){1, 1, 1, a}, 0, 0, 1, 1);
+        }
+        quad_batch_draw(&b->sprites, r, g.token_lib[image_idx].tex[view]);
+    }
     
-    if (t->selected && view == 0) {
-        SDL_SetRenderDrawColor(r, 255, 255, 0, 255);
-        SDL_RenderRect(r, &(SDL_FRect){sx, sy, sw, sh});
+    if (view == 0) {
+        for (int p = 0; p < n; p++)
+            if (rec[run[p]].selected) quad_batch_outline(&b->colors, rects[p], (SDL_FColor){1, 1, 0, 1});
+        quad_batch_draw(&b->colors, r, NULL);
     }
     
-    // Draw rank letter (M or C) for minions and captains
-    if (t->rank != RANK_NONE && g.font_data) {
-        const char *letter = (t->rank == RANK_MINION) ? "M" : "C";
-        int w, h;
-        SDL_Texture *tex = bake_text_once(r, letter, &w, &h, (SDL_Color){0,0,0,255}, 96.0f * c->zoom);
-        if (tex) {
-            float lw = w, lh = h;
-            SDL_RenderTexture(r, tex, NULL, &(SDL_FRect){sx + sw/2 - lw/2, sy + sh/2 - lh/2, lw, lh});
-            SDL_DestroyTexture(tex);  // Not cached, create/destroy each frame
+    // Rank letters (M or C) for minions and captains, one call per letter
+    if (!g.font_data) return;
+    for (int rank = RANK_NONE + 1; rank < RANK_COUNT; rank++) {
+        RankLetter *l = NULL;
+        for (int p = 0; p < n; p++) {
+            if (rec[run[p]].rank != rank) continue;
+            if (!l && !(l = rank_letter_get(r, view, rank, c->zoom))) break;
+            float k = RANK_LETTER_SIZE * c->zoom / l->size;
+            float lw = l->w * k, lh = l->h * k;
+            SDL_FRect q = rects[p];
+            quad_batch_add(&b->sprites, (SDL_FRect){q.x + q.w/2 - lw/2, q.y + q.h/2 - lh/2, lw, lh}, (SDL_FColor){1, 1, 1, 1}, 0, 0, 1, 1);
         }
+        if (l) quad_batch_draw(&b->sprites, r, l->tex);
     }
-    
 }
 
-static void render_token_aura(SDL_Renderer *r, Token *t, const Camera *c) {
-    if (t->aura <= 0 || t->hidden) return;
-    
-    // Aura covers the token's cells plus aura radius in each direction
-    int aura_size = t->size + t->aura * 2;  // Token size + aura on both sides
-    int aura_gx = t->grid_x - t->aura;
-    // Account for token extending upward (like render_token does)
-    int aura_gy = t->grid_y - t->aura - (t->size - 1);
-    
-    float ax = (aura_gx * g.grid_size + g.grid_off_x - c->x) * c->zoom;
-    float ay = (aura_gy * g.grid_size + g.grid_off_y - c->y) * c->zoom;
-    float aw = aura_size * g.grid_size * c->zoom;
-    float ah = aura_size * g.grid_size * c->zoom;
-    
+// Token layer for the tokens that passed culling. Tokens are taken in drawing order into runs, a run
+// ending at the first token that overlaps one already in it, and each run is drawn by
+// render_token_run. Within a run nothing overlaps, so the result is the same as drawing each token
+// whole in turn, and the topmost token is the one token_at picks.
+// Token images are loaded by scene capture on the main thread, never here.
+static void render_tokens(SDL_Renderer *r, const Scene *s, int view, const TokenCull *tc) {
+    const Camera *c = &s->cam;
+    const Token *rec = s->tokens->rec;
+    float thick = 3 * c->zoom, letter = RANK_LETTER_SIZE * c->zoom;
+    int run[TOKEN_RUN_MAX], n = 0;
+    SDL_FRect rects[TOKEN_RUN_MAX], extents[TOKEN_RUN_MAX];
     SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_BLEND);
-    SDL_SetRenderDrawColor(r, 135, 206, 250, 100);  // Light blue, semi-transparent
-    SDL_RenderFillRect(r, &(SDL_FRect){ax, ay, aw, ah});
-    SDL_SetRenderDrawColor(r, 135, 206, 250, 200);  // Light blue border
-    SDL_RenderRect(r, &(SDL_FRect){ax, ay, aw, ah});
+    for (int k = 0; k < tc->token_count; k++) {
+        const Token *t = &rec[tc->tokens[k]];
+        const Asset *img = &g.token_lib[t->image_idx];
+        if (!img->tex[view]) continue;
+        float scale = (s->grid_size * t->size) / (float)img->w * c->zoom;
+        float sw = img->w * scale, sh = img->h * scale;
+        float sx = (t->grid_x * s->grid_size + s->grid_off_x - c->x) * c->zoom;
+        float sy = (t->grid_y * s->grid_size + s->grid_off_y - c->y) * c->zoom - (sh - s->grid_size * c->zoom);
+        // Everything the token puts on screen: the squad border around the sprite, the rank letter over its centre
+        float x0 = sx, y0 = sy, x1 = sx + sw, y1 = sy + sh;
+        if (t->squad >= 0) { x0 -= thick; y0 -= thick; x1 += thick; y1 += thick; }
+        if (t->rank != RANK_NONE) {
+            float cx = sx + sw/2, cy = sy + sh/2;
+            x0 = fminf(x0, cx - letter/2); y0 = fminf(y0, cy - letter/2);
+            x1 = fmaxf(x1, cx + letter/2); y1 = fmaxf(y1, cy + letter/2);
+        }
+        bool overlaps = n == TOKEN_RUN_MAX;
+        for (int p = 0; p < n && !overlaps; p++) {
+            const SDL_FRect *e = &extents[p];
+            overlaps = x0 < e->x + e->w && e->x < x1 && y0 < e->y + e->h && e->y < y1;
+        }
+        if (overlaps) {
+            render_token_run(r, s, view, run, rects, n);
+            n = 0;
+        }
+        run[n] = tc->tokens[k];
+        rects[n] = (SDL_FRect){sx, sy, sw, sh};
+        extents[n++] = (SDL_FRect){x0, y0, x1 - x0, y1 - y0};
+    }
+    render_token_run(r, s, view, run, rects, n);
+}
+
+// Aura squares under the tokens that passed culling, fills and borders in one geometry call
+static void render_token_auras(SDL_Renderer *r, const Scene *s, int view, const TokenCull *tc) {
+    QuadBatch *b = &g.token_batch[view].colors;
+    const Camera *c = &s->cam;
+    SDL_FColor fill = fcolor((SDL_Color){135, 206, 250, 100});    // Light blue, semi-transparent
+    SDL_FColor border = fcolor((SDL_Color){135, 206, 250, 200});
+    for (int k = 0; k < tc->aura_count; k++) {
+        const Token *t = &s->tokens->rec[tc->auras[k]];
+        // Aura covers the token's cells plus aura radius in each direction; the token extends upward
+        int aura_size = t->size + t->aura * 2;
+        int aura_gx = t->grid_x - t->aura;
+        int aura_gy = t->grid_y - t->aura - (t->size - 1);
+        SDL_FRect q = {(aura_gx * s->grid_size + s->grid_off_x - c->x) * c->zoom,
+                       (aura_gy * s->grid_size + s->grid_off_y - c->y) * c->zoom,
+                       aura_size * s->grid_size * c->zoom, aura_size * s->grid_size * c->zoom};
+        quad_batch_fill(b, q, fill);
+        quad_batch_outline(b, q, border);
+    }
+    SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_BLEND);
+    quad_batch_draw(b, r, NULL);
 }
 
-static void render_token_markers(SDL_Renderer *r, Token *t, const Camera *c, int view) {
+static void render_token_markers(SDL_Renderer *r, const Token *t, const Scene *s, int view) {
     if (t->hidden && view == 1) return;
-    int gx = t->grid_x * g.grid_size + g.grid_off_x;
-    int gy = t->grid_y * g.grid_size + g.grid_off_y;
+    const Camera *c = &s->cam;
+    int gx = t->grid_x * s->grid_size + s->grid_off_x;
+    int gy = t->grid_y * s->grid_size + s->grid_off_y;
     Asset *img = &g.token_lib[t->image_idx];
     if (!img->loaded) return;
-    float scale = (g.grid_size * t->size) / (float)img->w * c->zoom;
+    float scale = (s->grid_size * t->size) / (float)img->w * c->zoom;
     float sw = img->w * scale, sh = img->h * scale;
     float sx = (gx - c->x) * c->zoom;
-    float sy = (gy - c->y) * c->zoom - (sh - g.grid_size * c->zoom);
+    float sy = (gy - c->y) * c->zoom - (sh - s->grid_size * c->zoom);
     
     // Damage number at top center
-    if (t->damage > 0) {
-        if (!t->damage_tex[view] || t->cached_dmg[view] != t->damage) {
-            if (t->damage_tex[view]) SDL_DestroyTexture(t->damage_tex[view]);
-            char buf[16]; snprintf(buf, 16, "%d", t->damage);
-            SDL_Color white = {255, 255, 255, 255};
-            int w, h;
-            t->damage_tex[view] = bake_text_once(r, buf, &w, &h, white, 20.0f);
-            t->cached_dmg[view] = t->damage;
-        }
-        if (t->damage_tex[view]) {
-            float w, h; SDL_GetTextureSize(t->damage_tex[view], &w, &h);
-            SDL_SetRenderDrawColor(r, 200, 0, 0, 230);
-            SDL_RenderFillRect(r, &(SDL_FRect){sx + sw/2 - w/2 - 2, sy - h - 4, w + 4, h + 4});
-            SDL_SetRenderDrawColor(r, 255, 255, 255, 255);
-            SDL_RenderRect(r, &(SDL_FRect){sx + sw/2 - w/2 - 2, sy - h - 4, w + 4, h + 4});
-            SDL_RenderTexture(r, t->damage_tex[view], NULL, &(SDL_FRect){sx + sw/2 - w/2, sy - h - 2, w, h});
-        }
+    if (t->damage > 0 && g.font_data) {
+        char buf[16]; snprintf(buf, 16, "%d", t->damage);
+        int iw, ih; text_measure(buf, 20.0f, &iw, &ih);
+        float w = iw, h = ih;
+        SDL_SetRenderDrawColor(r, 200, 0, 0, 230);
+        SDL_RenderFillRect(r, &(SDL_FRect){sx + sw/2 - w/2 - 2, sy - h - 4, w + 4, h + 4});
+        SDL_SetRenderDrawColor(r, 255, 255, 255, 255);
+        SDL_RenderRect(r, &(SDL_FRect){sx + sw/2 - w/2 - 2, sy - h - 4, w + 4, h + 4});
+        text_draw(r, buf, sx + sw/2 - w/2, sy - h - 2, 20.0f, 1.0f, (SDL_Color){255, 255, 255, 255});
     }
     
     // Condition tags - always show ALL active conditions, scaling to fit
+    static const char *cond_abbrev[COND_COUNT] = {"BL","DA","FR","GR","RE","SL","TA","WE"};
     static const SDL_Color cond_colors[COND_COUNT] = {
         {220,20,20,255}, {255,215,0,255}, {147,51,234,255}, {255,140,0,255},
         {139,69,19,255}, {30,144,255,255}, {255,20,147,255}, {50,205,50,255}
@@ -624,14 +2528,13 @@ static void render_token_markers(SDL_Renderer *r, Token *t, const Camera *c, int
             SDL_RenderRect(r, &tag_bg);
             
             // Text - scaled to match tag size
-            if (g.cond_tex[view][i]) {
-                float text_size_multiplier = 2.0f * scale_factor;
-                float text_w = g.cond_w * c->zoom * text_size_multiplier;
-                float text_h = g.cond_h * c->zoom * text_size_multiplier;
-                SDL_FRect text_dst = {tag_x + padding + (tag_width - text_w) / 2, 
-                                      tag_y + padding + (tag_height - text_h) / 2, 
-                                      text_w, text_h};
-                SDL_RenderTexture(r, g.cond_tex[view][i], NULL, &text_dst);
+            if (g.font_data) {
+                float text_zoom = c->zoom * 2.0f * scale_factor;
+                int tw, th; text_measure(cond_abbrev[i], 16.0f, &tw, &th);
+                float text_w = tw * text_zoom;
+                float text_h = th * text_zoom;
+                text_draw(r, cond_abbrev[i], tag_x + padding + (tag_width - text_w) / 2,
+                          tag_y + padding + (tag_height - text_h) / 2, 16.0f, text_zoom, (SDL_Color){255, 255, 255, 255});
             }
             
             // Move up for next tag
@@ -640,11 +2543,100 @@ static void render_token_markers(SDL_Renderer *r, Token *t, const Camera *c, int
     }
 }
 
-static void render_view(int view) {
-    Window *win = view == 0 ? &g.dm : &g.player;
-    SDL_Renderer *r = win->ren;
-    Camera *c = &g.cam[view];
-    SDL_GetWindowSize(win->win, &win->w, &win->h);
+// Screen pixels around a token's sprite that its markers may cover (the damage box sits above it
+// at a fixed text size)
+#define TOKEN_MARKER_MARGIN 48.0f
+
+// World pixels a view shows
+typedef struct { float x0, y0, x1, y1; } ViewRect;
+
+static inline ViewRect view_rect(const Scene *s) {
+    const Camera *c = &s->cam;
+    return (ViewRect){c->x, c->y, c->x + s->win_w / c->zoom, c->y + s->win_h / c->zoom};
+}
+
+static inline bool view_overlaps(const ViewRect *v, float x0, float y0, float x1, float y1) {
+    return x1 >= v->x0 && x0 <= v->x1 && y1 >= v->y0 && y0 <= v->y1;
+}
+
+// Fills a view's token store in one pass over the packed fields beside the pool: the records of the
+// tokens some layer draws, in drawing order, and the per-layer lists of them. Anything outside the
+// view is dropped first, so off-screen tokens cost no fog lookup, record copy or draw call. The player
+// view also skips hidden tokens and those whose anchor cell is under fog; auras are never drawn for
+// hidden tokens, and markers only for tokens that have some. Main thread, after the scene's camera,
+// window size and fog are set.
+static void token_cull(TokenStore *ts, const Scene *s, int view) {
+    TokenCull *tc = &ts->cull;
+    ts->count = 0;
+    ts->selected = -1;
+    tc->aura_count = tc->token_count = tc->marker_count = 0;
+    tc->auras_culled = tc->tokens_culled = tc->markers_culled = 0;
+    int n = g.token_pool.count;
+    if (n > ts->cap) {
+        Token *rec = realloc(ts->rec, n * sizeof(Token));
+        if (!rec) return;
+        ts->rec = rec;
+        ts->cap = n;
+    }
+    if (n > tc->cap) {
+        int *auras = realloc(tc->auras, n * sizeof(int));
+        if (!auras) return;
+        tc->auras = auras;
+        int *tokens = realloc(tc->tokens, n * sizeof(int));
+        if (!tokens) return;
+        tc->tokens = tokens;
+        int *markers = realloc(tc->markers, n * sizeof(int));
+        if (!markers) return;
+        tc->markers = markers;
+        tc->cap = n;
+    }
+    float aspect[MAX_ASSETS];  // Image height over width, which sets how far a sprite reaches above its cells
+    for (int k = 0; k < g.token_lib_count; k++) {
+        const Asset *img = &g.token_lib[k];
+        aspect[k] = img->w > 0 ? (float)img->h / img->w : 1.0f;
+    }
+    ViewRect v = view_rect(s);
+    float gs = s->grid_size, ox = s->grid_off_x, oy = s->grid_off_y;
+    float border = 3, margin = TOKEN_MARKER_MARGIN / s->cam.zoom;  // Squad border is 3 world pixels
+    int selected = -1;
+    POOL_FOR(g.token_pool, i) {
+        if (i >= token_hot.cap) continue;
+        uint8_t f = token_hot.flags[i];
+        if (selected < 0 && (f & TOKEN_HOT_SELECTED)) selected = i;
+        int image = token_hot.image[i];
+        float size = token_hot.size[i] * gs;
+        float x0 = token_hot.cell_x[i] * gs + ox, y1 = (token_hot.cell_y[i] + 1) * gs + oy;
+        float y0 = y1 - size * (image >= 0 && image < g.token_lib_count ? aspect[image] : 1.0f), x1 = x0 + size;
+        float a = token_hot.aura[i] * gs;
+        bool aura = token_hot.aura[i] > 0 && !(f & TOKEN_HOT_HIDDEN);
+        bool aura_on = aura && view_overlaps(&v, x0 - a, y1 - size - a, x1 + a, y1 + a);
+        bool token_on = view_overlaps(&v, x0 - border, y0 - border, x1 + border, y1 + border);
+        bool marker_on = (f & TOKEN_HOT_MARKED) && view_overlaps(&v, x0 - margin, y0 - margin, x1 + margin, y1 + margin);
+        tc->auras_culled += aura && !aura_on;
+        tc->tokens_culled += !token_on;
+        tc->markers_culled += (f & TOKEN_HOT_MARKED) && !marker_on;
+        if (!aura_on && !token_on && !marker_on) continue;
+        if (view == 1 && ((f & TOKEN_HOT_HIDDEN) || !fog_grid_get(&s->fog, token_hot.cell_x[i], token_hot.cell_y[i]))) continue;
+        int k = ts->count++;
+        ts->rec[k] = g.tokens[i];
+        if (i == selected) ts->selected = k;
+        if (aura_on) tc->auras[tc->aura_count++] = k;
+        if (token_on) tc->tokens[tc->token_count++] = k;
+        if (marker_on) tc->markers[tc->marker_count++] = k;
+        if (token_on || marker_on) asset_request(&g.token_lib[ts->rec[k].image_idx], true);
+    }
+    // The DM panel shows the selected token's conditions wherever it is
+    if (view == 0 && selected >= 0 && ts->selected < 0) {
+        ts->selected = ts->count;
+        ts->rec[ts->count++] = g.tokens[selected];
+    }
+}
+
+// Draws one view from its scene. The player view runs on the player render thread, so anything it
+// reaches outside the scene must be per-view (atlas, fog caches, measure text) or only read.
+static void render_view(const Scene *s, int view) {
+    SDL_Renderer *r = view == 0 ? g.dm.ren : g.player.ren;
+    const Camera *c = &s->cam;
     
     PROFILE_BEGIN(clear_screen);
     SDL_SetRenderDrawColor(r, 20, 20, 20, 255);
@@ -652,12 +2644,9 @@ static void render_view(int view) {
     PROFILE_END(clear_screen);
     
     PROFILE_BEGIN(map_render);
-    if (g.map_current < g.map_count) {
-        Asset *m = &g.map_assets[g.map_current];
-        ensure_asset_loaded(m);
-        if (m->tex[view]) {
-            SDL_RenderTexture(r, m->tex[view], NULL, &(SDL_FRect){-c->x*c->zoom, -c->y*c->zoom, m->w*c->zoom, m->h*c->zoom});
-        }
+    if (s->map_current >= 0) {
+        Asset *m = &g.map_assets[s->map_current];
+        if (m->tiles) map_tiles_draw(r, m->tiles, c, s->win_w, s->win_h, view);
     }
     PROFILE_END(map_render);
     
@@ -666,17 +2655,17 @@ static void render_view(int view) {
     if (view == 0 && g.show_grid) {
         SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_BLEND);
         SDL_SetRenderDrawColor(r, 100, 100, 100, 100);
-        int sc = (c->x - g.grid_off_x) / g.grid_size;
-        int ec = ((c->x + win->w/c->zoom) - g.grid_off_x) / g.grid_size + 1;
-        int sr = (c->y - g.grid_off_y) / g.grid_size;
-        int er = ((c->y + win->h/c->zoom) - g.grid_off_y) / g.grid_size + 1;
+        int sc = (c->x - s->grid_off_x) / s->grid_size;
+        int ec = ((c->x + s->win_w/c->zoom) - s->grid_off_x) / s->grid_size + 1;
+        int sr = (c->y - s->grid_off_y) / s->grid_size;
+        int er = ((c->y + s->win_h/c->zoom) - s->grid_off_y) / s->grid_size + 1;
         for (int x = sc; x <= ec; x++) {
-            float px = (x * g.grid_size + g.grid_off_x - c->x) * c->zoom;
-            SDL_RenderLine(r, px, 0, px, win->h);
+            float px = (x * s->grid_size + s->grid_off_x - c->x) * c->zoom;
+            SDL_RenderLine(r, px, 0, px, s->win_h);
         }
         for (int y = sr; y <= er; y++) {
-            float py = (y * g.grid_size + g.grid_off_y - c->y) * c->zoom;
-            SDL_RenderLine(r, 0, py, win->w, py);
+            float py = (y * s->grid_size + s->grid_off_y - c->y) * c->zoom;
+            SDL_RenderLine(r, 0, py, s->win_w, py);
         }
     }
     PROFILE_END(grid_render);
@@ -687,8 +2676,21 @@ static void render_view(int view) {
         {255,50,50,128},{50,150,255,128},{50,255,50,128},{255,255,50,128},
         {255,150,50,128},{200,50,255,128},{50,255,255,128},{255,255,255,128}
     };
-    for (int i = 0; i < g.drawing_count; i++) {
-        Drawing *d = &g.drawings[i];
+    ViewRect v = view_rect(s);
+    int drawings_culled = 0;
+    for (int i = 0; i < s->drawing_count; i++) {
+        const Drawing *d = &s->drawings[i];
+        float bx0 = fminf(d->x1, d->x2), bx1 = fmaxf(d->x1, d->x2);
+        float by0 = fminf(d->y1, d->y2), by1 = fmaxf(d->y1, d->y2);
+        if (d->type != SHAPE_RECT) {  // Circle through the two corners, centred between them
+            float cx = (d->x1 + d->x2) / 2.0f, cy = (d->y1 + d->y2) / 2.0f;
+            float rad = sqrtf((float)(d->x2-d->x1)*(d->x2-d->x1) + (float)(d->y2-d->y1)*(d->y2-d->y1)) / 2;
+            bx0 = cx - rad; bx1 = cx + rad; by0 = cy - rad; by1 = cy + rad;
+        }
+        if (!view_overlaps(&v, bx0 - 1, by0 - 1, bx1 + 1, by1 + 1)) {
+            drawings_culled++;
+            continue;
+        }
         SDL_Color col = cols[d->color % 8];
         float x1 = (d->x1 - c->x) * c->zoom, y1 = (d->y1 - c->y) * c->zoom;
         float x2 = (d->x2 - c->x) * c->zoom, y2 = (d->y2 - c->y) * c->zoom;
@@ -707,22 +2709,27 @@ static void render_view(int view) {
             render_circle(r, (x1+x2)/2, (y1+y2)/2, rad, false, b);
         }
     }
+    PROFILE_COUNT(drawings_drawn, s->drawing_count - drawings_culled);
+    PROFILE_COUNT(drawings_culled, drawings_culled);
     PROFILE_END(drawings_render);
     
+    // Capture already decided what each token layer draws (see token_cull)
+    const TokenCull *tc = &s->tokens->cull;
+    PROFILE_COUNT(auras_drawn, tc->aura_count);
+    PROFILE_COUNT(auras_culled, tc->auras_culled);
+    PROFILE_COUNT(tokens_drawn, tc->token_count);
+    PROFILE_COUNT(tokens_culled, tc->tokens_culled);
+    PROFILE_COUNT(markers_drawn, tc->marker_count);
+    PROFILE_COUNT(markers_culled, tc->markers_culled);
+    
     // Z-Layer: Token auras (under tokens)
     PROFILE_BEGIN(token_auras_render);
-    for (int i = 0; i < g.token_count; i++) {
-        if (view == 1 && !fog_get(g.tokens[i].grid_x, g.tokens[i].grid_y)) continue;
-        render_token_aura(r, &g.tokens[i], c);
-    }
+    render_token_auras(r, s, view, tc);
     PROFILE_END(token_auras_render);
     
     // Z-Layer: Tokens (without damage/conditions)
     PROFILE_BEGIN(tokens_render);
-    for (int i = 0; i < g.token_count; i++) {
-        if (view == 1 && !fog_get(g.tokens[i].grid_x, g.tokens[i].grid_y)) continue;
-        render_token(r, &g.tokens[i], c, view);
-    }
+    render_tokens(r, s, view, tc);
     PROFILE_END(tokens_render);
     
     if (view == 0 && g.draw_shape) {
@@ -753,35 +2760,60 @@ static void render_view(int view) {
     // Z-Layer: Fog of War
     PROFILE_BEGIN(fog_render);
     SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_BLEND);
-    SDL_SetRenderDrawColor(r, 0, 0, 0, view == 0 ? 180 : 255);
-    int sc = (c->x - g.grid_off_x) / g.grid_size;
-    int ec = ((c->x + win->w/c->zoom) - g.grid_off_x) / g.grid_size + 1;
-    int sr = (c->y - g.grid_off_y) / g.grid_size;
-    int er = ((c->y + win->h/c->zoom) - g.grid_off_y) / g.grid_size + 1;
-    if (sc < 0) sc = 0;
-    if (sr < 0) sr = 0;
-    if (ec > g.fog_w) ec = g.fog_w;
-    if (er > g.fog_h) er = g.fog_h;
-    for (int y = sr; y < er; y++) {
-        for (int x = sc; x < ec; x++) {
-            if (!g.fog[y*g.fog_w+x]) {
-                SDL_FRect cell = {
-                    (x*g.grid_size + g.grid_off_x - c->x)*c->zoom,
-                    (y*g.grid_size + g.grid_off_y - c->y)*c->zoom,
-                    g.grid_size*c->zoom, g.grid_size*c->zoom
-                };
-                SDL_RenderFillRect(r, &cell);
+    float cell_px = s->grid_size * c->zoom;
+    FogMask *m = &g.fog_mask[view];
+    SoftFog *sf = &g.fog_soft[view];
+    const DirtyRect *fd = &s->fog_dirty;
+    if (fd->x0 < fd->x1 && fd->y0 < fd->y1) {  // Both backends track changes so switching modes stays current
+        dirty_rect_add(&m->dirty, fd->x0, fd->y0, fd->x1, fd->y1);
+        dirty_rect_add(&sf->dirty, fd->x0, fd->y0, fd->x1, fd->y1);
+    }
+    if (s->fog_render == FOG_RENDER_SOFT) {
+        if (soft_fog_resize(sf, &s->fog)) {
+            PROFILE_BEGIN(fog_soft_update);
+            soft_fog_blur(sf, &s->fog);
+            soft_fog_upload(sf, r, view);
+            PROFILE_END(fog_soft_update);
+            if (sf->tex) {
+                SDL_RenderTexture(r, sf->tex, NULL, &(SDL_FRect){
+                    (s->grid_off_x - c->x)*c->zoom, (s->grid_off_y - c->y)*c->zoom,
+                    s->fog.w*cell_px, s->fog.h*cell_px});
             }
         }
+    } else if (s->fog_render == FOG_RENDER_MASK) {
+        fog_mask_update(m, r, &s->fog, view);
+        if (m->tex) {
+            SDL_RenderTexture(r, m->tex, NULL, &(SDL_FRect){
+                (s->grid_off_x - c->x)*c->zoom, (s->grid_off_y - c->y)*c->zoom,
+                m->w*cell_px, m->h*cell_px});
+        }
+    } else {
+        SDL_SetRenderDrawColor(r, 0, 0, 0, view == 0 ? 180 : 255);
+        int sc = (c->x - s->grid_off_x) / s->grid_size;
+        int ec = ((c->x + s->win_w/c->zoom) - s->grid_off_x) / s->grid_size + 1;
+        int sr = (c->y - s->grid_off_y) / s->grid_size;
+        int er = ((c->y + s->win_h/c->zoom) - s->grid_off_y) / s->grid_size + 1;
+        if (sc < 0) sc = 0;
+        if (sr < 0) sr = 0;
+        if (ec > s->fog.w) ec = s->fog.w;
+        if (er > s->fog.h) er = s->fog.h;
+        FogRuns *fr = &g.fog_runs[view];
+        fog_runs_update(fr, &s->fog, sc, sr, ec, er);
+        for (int i = 0; i < fr->count; i++) {
+            const SDL_FRect *run = &fr->cells[i];
+            fr->screen[i] = (SDL_FRect){
+                (run->x*s->grid_size + s->grid_off_x - c->x)*c->zoom,
+                (run->y*s->grid_size + s->grid_off_y - c->y)*c->zoom,
+                run->w*cell_px, run->h*cell_px
+            };
+        }
+        if (fr->count > 0) SDL_RenderFillRects(r, fr->screen, fr->count);
     }
     PROFILE_END(fog_render);
     
     // Z-Layer: Damage and Condition Markers (topmost layer for tokens)
     PROFILE_BEGIN(token_markers_render);
-    for (int i = 0; i < g.token_count; i++) {
-        if (view == 1 && !fog_get(g.tokens[i].grid_x, g.tokens[i].grid_y)) continue;
-        render_token_markers(r, &g.tokens[i], c, view);
-    }
+    for (int k = 0; k < tc->marker_count; k++) render_token_markers(r, &s->tokens->rec[tc->markers[k]], s, view);
     PROFILE_END(token_markers_render);
     
     // Calibration grid overlay (show while active and after drawing)
@@ -804,17 +2836,15 @@ static void render_view(int view) {
     
     // Measurement tool (visible on both views)
     PROFILE_BEGIN(measurement_render);
-    if (g.measure_active) {
-        float mx, my;
-        SDL_GetMouseState(&mx, &my);
-        int end_gx, end_gy;
-        screen_to_grid(mx, my, c, &end_gx, &end_gy);
+    if (s->measure_active) {
+        int end_gx = ((int)(s->mouse_x / c->zoom + c->x) - s->grid_off_x) / s->grid_size;
+        int end_gy = ((int)(s->mouse_y / c->zoom + c->y) - s->grid_off_y) / s->grid_size;
         
         // Calculate center points of grid cells
-        float start_wx = g.measure_start_gx * g.grid_size + g.grid_off_x + g.grid_size / 2.0f;
-        float start_wy = g.measure_start_gy * g.grid_size + g.grid_off_y + g.grid_size / 2.0f;
-        float end_wx = end_gx * g.grid_size + g.grid_off_x + g.grid_size / 2.0f;
-        float end_wy = end_gy * g.grid_size + g.grid_off_y + g.grid_size / 2.0f;
+        float start_wx = s->measure_start_gx * s->grid_size + s->grid_off_x + s->grid_size / 2.0f;
+        float start_wy = s->measure_start_gy * s->grid_size + s->grid_off_y + s->grid_size / 2.0f;
+        float end_wx = end_gx * s->grid_size + s->grid_off_x + s->grid_size / 2.0f;
+        float end_wy = end_gy * s->grid_size + s->grid_off_y + s->grid_size / 2.0f;
         
         // Convert to screen space
         float start_sx = (start_wx - c->x) * c->zoom;
@@ -832,8 +2862,8 @@ static void render_view(int view) {
         render_circle(r, end_sx, end_sy, 5, true, (SDL_Color){255, 255, 0, 200});
         
         // Calculate distance in grid cells (Chebyshev distance - diagonal = 1 cell)
-        int dx = abs(end_gx - g.measure_start_gx);
-        int dy = abs(end_gy - g.measure_start_gy);
+        int dx = abs(end_gx - s->measure_start_gx);
+        int dy = abs(end_gy - s->measure_start_gy);
         int distance = (dx > dy) ? dx : dy;  // max(dx, dy)
         
         // Display distance text (cached per-view to avoid creating/destroying textures every frame)
@@ -842,11 +2872,11 @@ static void render_view(int view) {
                 char dist_buf[64];
                 snprintf(dist_buf, 64, "%d cells", distance);
                 SDL_Color yellow = {255, 255, 0, 255};
-                update_cached_text(&g.ui_measure[view], r, dist_buf, yellow);
+                update_cached_text(&g.ui_measure[view], dist_buf, yellow);
                 g.cached_measure_dist[view] = distance;
             }
             
-            if (g.ui_measure[view].tex) {
+            if (g.ui_measure[view].text[0]) {
                 // Position text at midpoint of line, slightly above
                 float mid_sx = (start_sx + end_sx) / 2.0f;
                 float mid_sy = (start_sy + end_sy) / 2.0f - g.ui_measure[view].h - 10;
@@ -860,7 +2890,7 @@ static void render_view(int view) {
                 SDL_RenderRect(r, &(SDL_FRect){mid_sx - g.ui_measure[view].w/2 - 5, mid_sy - 5, g.ui_measure[view].w + 10, g.ui_measure[view].h + 10});
                 
                 // Text
-                SDL_RenderTexture(r, g.ui_measure[view].tex, NULL, &(SDL_FRect){mid_sx - g.ui_measure[view].w/2, mid_sy, g.ui_measure[view].w, g.ui_measure[view].h});
+                draw_cached_text(r, &g.ui_measure[view], mid_sx - g.ui_measure[view].w/2, mid_sy);
             }
         }
     }
@@ -881,11 +2911,11 @@ static void render_view(int view) {
             for (int dx = -radius; dx <= radius; dx++) {
                 int cell_x = gx + dx;
                 int cell_y = gy + dy;
-                if (cell_x >= 0 && cell_x < g.fog_w && cell_y >= 0 && cell_y < g.fog_h) {
-                    float cx = (cell_x * g.grid_size + g.grid_off_x - c->x) * c->zoom;
-                    float cy = (cell_y * g.grid_size + g.grid_off_y - c->y) * c->zoom;
-                    float cw = g.grid_size * c->zoom;
-                    float ch = g.grid_size * c->zoom;
+                if (cell_x >= 0 && cell_x < s->fog.w && cell_y >= 0 && cell_y < s->fog.h) {
+                    float cx = (cell_x * s->grid_size + s->grid_off_x - c->x) * c->zoom;
+                    float cy = (cell_y * s->grid_size + s->grid_off_y - c->y) * c->zoom;
+                    float cw = s->grid_size * c->zoom;
+                    float ch = s->grid_size * c->zoom;
                     
                     // Yellow tint for preview
                     SDL_SetRenderDrawColor(r, 255, 255, 0, 60);
@@ -905,7 +2935,7 @@ static void render_view(int view) {
         const char *tool_names[] = {"SELECT TOOL", "FOG OF WAR", "SQUAD ASSIGN", "DRAWING"};
         if (g.cached_tool != g.tool) {
             g.cached_tool = g.tool;
-            update_cached_text(&g.ui_tool, r, tool_names[g.tool], (SDL_Color){255,255,255,255});
+            update_cached_text(&g.ui_tool, tool_names[g.tool], (SDL_Color){255,255,255,255});
         }
         // Show current tool or calibration mode
         if (g.cal_active) {
@@ -913,31 +2943,25 @@ static void render_view(int view) {
             const char *cal_text = g.cal_has_box ? 
                 "GRID CALIBRATION - Arrows: move | Shift+Arrows: resize | +/-: cells | ENTER: confirm" : 
                 "GRID CALIBRATION - Click and drag to select grid area";
-            if (g.cached_cal_drag != g.cal_has_box || !g.ui_calibration.tex) {
+            if (g.cached_cal_drag != g.cal_has_box || !g.ui_calibration.text[0]) {
                 g.cached_cal_drag = g.cal_has_box;
-                update_cached_text(&g.ui_calibration, r, cal_text, (SDL_Color){255,255,100,255});
+                update_cached_text(&g.ui_calibration, cal_text, (SDL_Color){255,255,100,255});
             }
-            if (g.ui_calibration.tex) {
+            if (g.ui_calibration.text[0]) {
                 draw_ui_panel(r, 10, 10, g.ui_calibration.w + 40, g.ui_calibration.h + 20,
                               (SDL_Color){60,40,40,240}, (SDL_Color){200,150,100,255}, 
-                              g.ui_calibration.tex, 10, 10);
+                              &g.ui_calibration, 10, 10);
             }
-        } else if (g.ui_tool.tex) {
+        } else if (g.ui_tool.text[0]) {
             draw_ui_panel(r, 10, 10, g.ui_tool.w + 40, g.ui_tool.h + 20,
                           (SDL_Color){40,40,60,240}, (SDL_Color){100,100,150,255}, 
-                          g.ui_tool.tex, 10, 10);
+                          &g.ui_tool, 10, 10);
         }
         
         // Show tool-specific info below main tool display
         if (g.tool == TOOL_SELECT) {
             // Show selected token conditions
-            Token *selected_token = NULL;
-            for (int i = 0; i < g.token_count; i++) {
-                if (g.tokens[i].selected) {
-                    selected_token = &g.tokens[i];
-                    break;
-                }
-            }
+            const Token *selected_token = s->tokens->selected >= 0 ? &s->tokens->rec[s->tokens->selected] : NULL;
             
             if (selected_token) {
                 // Build condition list string
@@ -958,29 +2982,31 @@ static void render_view(int view) {
                 }
                 if (!has_any) sprintf(p, "None");
                 
-                update_cached_text(&g.ui_help, r, cond_buf, (SDL_Color){255,255,255,255});
-                if (g.ui_help.tex) {
+                update_cached_text(&g.ui_help, cond_buf, (SDL_Color){255,255,255,255});
+                if (g.ui_help.text[0]) {
                     draw_ui_panel(r, 10, 50, g.ui_help.w + 40, g.ui_help.h + 20,
                                   (SDL_Color){40,40,60,240}, (SDL_Color){100,100,150,255}, 
-                                  g.ui_help.tex, 10, 10);
+                                  &g.ui_help, 10, 10);
                 }
             }
         } else if (g.tool == TOOL_FOG) {
             // Show fog brush size
             char buf[64];
-            snprintf(buf, 64, "FOG BRUSH: %dx%d cells (+/- to adjust)", g.fog_brush_size, g.fog_brush_size);
-            update_cached_text(&g.ui_squad, r, buf, (SDL_Color){255,255,255,255});
-            if (g.ui_squad.tex) {
+            int cells = s->fog.w * s->fog.h;
+            snprintf(buf, 64, "FOG BRUSH: %dx%d cells (+/- to adjust) | %d%% revealed", g.fog_brush_size, g.fog_brush_size,
+                     cells > 0 ? (int)(fog_revealed_count() * 100LL / cells) : 0);
+            update_cached_text(&g.ui_squad, buf, (SDL_Color){255,255,255,255});
+            if (g.ui_squad.text[0]) {
                 draw_ui_panel(r, 10, 50, g.ui_squad.w + 40, g.ui_squad.h + 20,
                               (SDL_Color){40,40,60,240}, (SDL_Color){100,100,150,255}, 
-                              g.ui_squad.tex, 10, 10);
+                              &g.ui_squad, 10, 10);
             }
         } else if (g.tool == TOOL_SQUAD || g.tool == TOOL_DRAW) {
             char buf[64];
             const char *type = g.tool == TOOL_SQUAD ? "SQUAD" : "DRAW";
             snprintf(buf, 64, "%s: Color %d", type, g.current_squad);
-            update_cached_text(&g.ui_squad, r, buf, (SDL_Color){255,255,255,255});
-            if (g.ui_squad.tex) {
+            update_cached_text(&g.ui_squad, buf, (SDL_Color){255,255,255,255});
+            if (g.ui_squad.text[0]) {
                 static const SDL_Color squad_cols[8] = {
                     {255,50,50,255},{50,150,255,255},{50,255,50,255},{255,255,50,255},
                     {255,150,50,255},{200,50,255,255},{50,255,255,255},{255,255,255,255}
@@ -992,24 +3018,45 @@ static void render_view(int view) {
                 SDL_RenderFillRect(r, &(SDL_FRect){20, 60, 20, 20});
                 SDL_SetRenderDrawColor(r, 255, 255, 255, 255);
                 SDL_RenderRect(r, &(SDL_FRect){20, 60, 20, 20});
-                SDL_RenderTexture(r, g.ui_squad.tex, NULL, &(SDL_FRect){50, 60, g.ui_squad.w, g.ui_squad.h});
+                draw_cached_text(r, &g.ui_squad, 50, 60);
             }
         }
         
         if (g.dmg_input) {
             char buf[32]; snprintf(buf, 32, "%s: %s_", g.shift ? "HEAL" : "DAMAGE", g.dmg_buf);
-            update_cached_text(&g.ui_dmg, r, buf, g.shift ? (SDL_Color){100,255,100,255} : (SDL_Color){255,100,100,255});
-            if (g.ui_dmg.tex) {
-                int x = win->w/2 - (g.ui_dmg.w + 40)/2;
+            update_cached_text(&g.ui_dmg, buf, g.shift ? (SDL_Color){100,255,100,255} : (SDL_Color){255,100,100,255});
+            if (g.ui_dmg.text[0]) {
+                int x = s->win_w/2 - (g.ui_dmg.w + 40)/2;
                 SDL_Color border = g.shift ? (SDL_Color){100,200,100,255} : (SDL_Color){200,100,100,255};
                 draw_ui_panel(r, x, 20, g.ui_dmg.w + 40, g.ui_dmg.h + 20,
-                              (SDL_Color){40,40,60,240}, border, g.ui_dmg.tex, 20, 10);
+                              (SDL_Color){40,40,60,240}, border, &g.ui_dmg, 20, 10);
+            }
+        }
+        
+        // Background save: progress while writing, then the result for a moment
+        bool saving = SDL_GetAtomicInt(&save_rt.busy) != 0 && save_rt.slot >= 0;  // Autosave snapshots run unseen
+        if (saving || save_rt.notice_until) {
+            char buf[64];
+            if (saving) snprintf(buf, sizeof(buf), "SAVING SLOT %d... %d%%", save_rt.slot + 1, SDL_GetAtomicInt(&save_rt.progress) / 10);
+            else if (save_rt.slot < 0) snprintf(buf, sizeof(buf), "AUTOSAVE FAILED");
+            else if (save_rt.ok) snprintf(buf, sizeof(buf), "SAVED TO SLOT %d", save_rt.slot + 1);
+            else snprintf(buf, sizeof(buf), "SAVE TO SLOT %d FAILED", save_rt.slot + 1);
+            bool failed = !saving && !save_rt.ok;
+            update_cached_text(&g.ui_save, buf, failed ? (SDL_Color){255,100,100,255} : (SDL_Color){255,255,255,255});
+            if (g.ui_save.text[0]) {
+                float w = g.ui_save.w + 40, h = g.ui_save.h + 20, y = s->win_h - h - 10;
+                SDL_Color border = failed ? (SDL_Color){200,100,100,255} : (SDL_Color){100,100,150,255};
+                draw_ui_panel(r, 10, y, w, h, (SDL_Color){40,40,60,240}, border, &g.ui_save, 20, 10);
+                if (saving) {
+                    SDL_SetRenderDrawColor(r, 100, 200, 100, 255);
+                    SDL_RenderFillRect(r, &(SDL_FRect){11, y + h - 4, (w - 2) * SDL_GetAtomicInt(&save_rt.progress) / 1000.0f, 3});
+                }
             }
         }
         
-        if (g.cond_wheel && g.cond_token_idx >= 0) {
-            Token *t = &g.tokens[g.cond_token_idx];
-            float cx = win->w/2.0f, cy = win->h/2.0f;
+        if (g.cond_wheel && pool_live(&g.token_pool, g.cond_token_idx)) {
+            const Token *t = &g.tokens[g.cond_token_idx];
+            float cx = s->win_w/2.0f, cy = s->win_h/2.0f;
             float radius = 220.0f;
             float inner_radius = 70.0f;
             
@@ -1075,18 +3122,18 @@ static void render_view(int view) {
             }
             
             // Render condition names in each segment
+            static const char *cond_names[COND_COUNT] = {"Bleeding","Dazed","Frightened","Grabbed",
+                                                         "Restrained","Slowed","Taunted","Weakened"};
             for (int i = 0; i < COND_COUNT; i++) {
                 float mid_angle = (6.28318f * i + 6.28318f * (i + 1)) / (2.0f * COND_COUNT);
                 float mid_radius = (inner_radius + radius) / 2.0f;
                 float text_x = cx + cosf(mid_angle) * mid_radius;
                 float text_y = cy + sinf(mid_angle) * mid_radius;
                 
-                // Render text from pre-baked textures
-                if (g.cond_wheel_tex[i]) {
-                    float tw, th;
-                    SDL_GetTextureSize(g.cond_wheel_tex[i], &tw, &th);
-                    SDL_RenderTexture(r, g.cond_wheel_tex[i], NULL, &(SDL_FRect){text_x - tw/2.0f, text_y - th/2.0f, tw, th});
-                }
+                // Render text from the glyph atlas
+                int tw, th;
+                text_measure(cond_names[i], 16.0f, &tw, &th);
+                text_draw(r, cond_names[i], text_x - tw/2.0f, text_y - th/2.0f, 16.0f, 1.0f, (SDL_Color){255, 255, 255, 255});
             }
             
             // Center circle
@@ -1108,123 +3155,1354 @@ static void render_view(int view) {
             }
         }
     }
-    PROFILE_END(ui_render);
-    
-    PROFILE_BEGIN(present);
-    SDL_RenderPresent(r);
-    PROFILE_END(present);
+    if (view == 0 && profiler.show_overlay) profile_draw_overlay(r, s->win_w);
+    PROFILE_END(ui_render);
+    
+    PROFILE_BEGIN(present);
+    SDL_RenderPresent(r);
+    PROFILE_END(present);
+}
+
+// Fills the per-view fields of a scene and loads the assets it draws. Main thread only.
+static void scene_capture(Scene *s, int view) {
+    Window *win = view == 0 ? &g.dm : &g.player;
+    SDL_GetWindowSize(win->win, &win->w, &win->h);
+    s->win_w = win->w; s->win_h = win->h;
+    s->cam = g.cam[view];
+    s->grid_size = g.grid_size;
+    s->grid_off_x = g.grid_off_x;
+    s->grid_off_y = g.grid_off_y;
+    s->fog_render = g.fog_render;
+    // Only a loaded map is handed to the render thread; its tiles are not touched here after that
+    s->map_current = -1;
+    if (g.map_current < g.map_count) {
+        asset_request(&g.map_assets[g.map_current], true);
+        if (g.map_assets[g.map_current].loaded) s->map_current = g.map_current;
+    }
+    SDL_GetMouseState(&s->mouse_x, &s->mouse_y);
+    s->measure_active = g.measure_active;
+    s->measure_start_gx = g.measure_start_gx;
+    s->measure_start_gy = g.measure_start_gy;
+    s->fog_dirty = g.fog_changed[view];
+    g.fog_changed[view] = (DirtyRect){0, 0, 0, 0};
+}
+
+// Queues the token images no view has asked for yet, behind the urgent requests token_cull made
+static void token_lib_prefetch(void) {
+    for (int i = 0; i < g.token_lib_count; i++) asset_request(&g.token_lib[i], false);
+}
+
+// The DM scene aliases live fog, so it is only valid until the next input is handled. Drawings are
+// packed in drawing order; tokens are culled into the store.
+static void dm_scene_capture(Scene *s) {
+    static TokenStore tokens;
+    static Drawing *drawings;
+    static int drawing_cap;
+    scene_capture(s, 0);
+    s->fog = g.fog;
+    PROFILE_BEGIN(token_cull);
+    token_cull(&tokens, s, 0);
+    PROFILE_END(token_cull);
+    token_lib_prefetch();
+    s->tokens = &tokens;
+    s->drawing_count = pool_pack(&g.drawing_pool, (void **)&drawings, &drawing_cap);
+    s->drawings = drawings;
+}
+
+// Copies the state the player view reads into the snapshot. Fog rows are copied only where they
+// changed since the previous snapshot, so an unchanged fog costs nothing per frame.
+static void player_scene_capture(void) {
+    Scene *s = &player_rt.scene;
+    scene_capture(s, 1);
+    s->drawing_count = pool_pack(&g.drawing_pool, (void **)&player_rt.drawings, &player_rt.drawing_cap);
+    s->drawings = player_rt.drawings;
+    
+    FogGrid *f = &s->fog;
+    const DirtyRect *d = &s->fog_dirty;
+    if (!g.fog.bits) {
+        *f = (FogGrid){0};
+    } else if (!f->bits || f->w != g.fog.w || f->h != g.fog.h) {
+        size_t n = (size_t)g.fog.stride * g.fog.h;
+        uint64_t *bits = realloc(player_rt.fog_bits, n * sizeof(uint64_t));
+        if (bits) {
+            player_rt.fog_bits = bits;
+            memcpy(bits, g.fog.bits, n * sizeof(uint64_t));
+            *f = g.fog;
+            f->bits = bits;
+        } else {
+            *f = (FogGrid){0};
+        }
+    } else if (d->y0 < d->y1) {
+        memcpy(fog_row(f, d->y0), fog_row(&g.fog, d->y0), (size_t)(d->y1 - d->y0) * f->stride * sizeof(uint64_t));
+        f->version = g.fog.version;
+    }
+    
+    // Tokens under fog are dropped here, so the snapshot fog has to be current first
+    PROFILE_BEGIN(token_cull);
+    token_cull(&player_rt.tokens, s, 1);
+    PROFILE_END(token_cull);
+    token_lib_prefetch();
+    s->tokens = &player_rt.tokens;
+}
+
+static int player_render_thread(void *data) {
+    (void)data;
+    profile_thread = 1;
+    profiler.thread_ids[1] = SDL_GetCurrentThreadID();
+    while (1) {
+        SDL_WaitSemaphore(player_rt.go);
+        if (SDL_GetAtomicInt(&player_rt.quit)) break;
+        SDL_LockMutex(player_rt.lock);
+        PROFILE_BEGIN(render_player);
+        render_view(&player_rt.scene, 1);
+        PROFILE_END(render_player);
+        SDL_UnlockMutex(player_rt.lock);
+        SDL_SetAtomicInt(&player_rt.busy, 0);
+    }
+    return 0;
+}
+
+// Hands the player view to its thread if it is idle; returns false if the previous frame is still in flight
+static bool player_render_submit(void) {
+    if (SDL_GetAtomicInt(&player_rt.busy)) return false;
+    PROFILE_BEGIN(player_capture);
+    player_scene_capture();
+    PROFILE_END(player_capture);
+    if (!player_rt.thread) {  // No thread could be started: render inline
+        PROFILE_BEGIN(render_player);
+        render_view(&player_rt.scene, 1);
+        PROFILE_END(render_player);
+        return true;
+    }
+    SDL_SetAtomicInt(&player_rt.busy, 1);
+    SDL_SignalSemaphore(player_rt.go);
+    return true;
+}
+
+static void player_thread_stop(void) {
+    if (!player_rt.thread) return;
+    SDL_SetAtomicInt(&player_rt.quit, 1);
+    SDL_SignalSemaphore(player_rt.go);
+    SDL_WaitThread(player_rt.thread, NULL);
+    player_rt.thread = NULL;
+}
+
+static unsigned char *read_file(const char *path, int *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long sz = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *data = sz > 0 && sz <= 50*1024*1024 ? malloc(sz) : NULL;
+    if (data && fread(data, 1, sz, f) != (size_t)sz) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *len = (int)sz;
+    return data;
+}
+
+// Save asset table entry: the original compressed bytes of one distinct image
+typedef struct {
+    const char *path;
+    const unsigned char *data;
+    int len;
+    bool owned;  // Read from disk for this save, not an asset's blob
+    uint64_t hash;
+} SaveAsset;
+
+// Loaded form of a save table entry; lib_idx is filled the first time a map or token uses it
+typedef struct {
+    char path[256];
+    const unsigned char *data;  // Copied into the asset's blob once loaded
+    int len;
+    uint64_t hash;
+    int lib_idx[2];       // Map library, token library
+} LoadAsset;
+
+// Library index for a save table entry. New entries only get their path and bytes here; the asset
+// workers decode them once a view needs them (see asset_request).
+static int load_asset_index(LoadAsset *e, int kind, Asset *lib, int *lib_count) {
+    if (e->lib_idx[kind] >= 0) return e->lib_idx[kind];
+    for (int i = 0; i < *lib_count; i++) {
+        bool same_blob = lib[i].blob && e->data && lib[i].blob_len == e->len && !memcmp(lib[i].blob, e->data, e->len);
+        if (!strcmp(lib[i].path, e->path) || same_blob) return e->lib_idx[kind] = i;
+    }
+    if (!e->data || *lib_count >= MAX_ASSETS) return -1;
+    unsigned char *blob = malloc(e->len);
+    if (!blob) return -1;
+    memcpy(blob, e->data, e->len);
+    Asset *slot = &lib[*lib_count];
+    memset(slot, 0, sizeof(*slot));
+    snprintf(slot->path, sizeof(slot->path), "%s", e->path);
+    slot->blob = blob;
+    slot->blob_len = e->len;
+    return e->lib_idx[kind] = (*lib_count)++;
+}
+
+// Helper for loading embedded PNG data
+static int read_embedded_asset(FILE *f, int *out_idx, Asset *lib, int *lib_count, int max_count) {
+    // Read path
+    int path_len;
+    if (fread(&path_len, 4, 1, f) != 1) return -1;
+    char path[256] = {0};
+    if (path_len > 0 && path_len < 256) {
+        fread(path, 1, path_len, f);
+    }
+    
+    // Read PNG data
+    int png_len;
+    if (fread(&png_len, 4, 1, f) != 1) return -1;
+    if (png_len <= 0 || png_len > 50*1024*1024) return -1; // Sanity check: max 50MB
+    
+    unsigned char *png_data = malloc(png_len);
+    if (!png_data) return -1;
+    if (fread(png_data, 1, png_len, f) != (size_t)png_len) {
+        free(png_data);
+        return -1;
+    }
+    
+    // Check if asset already exists in library
+    for (int i = 0; i < *lib_count; i++) {
+        if (strcmp(lib[i].path, path) == 0) {
+            free(png_data);
+            *out_idx = i;
+            return 0;
+        }
+    }
+    
+    // Add new asset to library
+    if (*lib_count >= max_count) {
+        free(png_data);
+        return -1;
+    }
+    
+    int idx = *lib_count;
+    if (load_asset_from_memory(png_data, png_len, &lib[idx], path) == 0) {
+        lib[idx].blob = png_data;  // Kept so saving again does not need the original file
+        lib[idx].blob_len = png_len;
+        (*lib_count)++;
+        *out_idx = idx;
+        return 0;
+    }
+    
+    free(png_data);
+    return -1;
+}
+
+// Versions 2-4: fields in a fixed order, assets inline. Called after the magic is read.
+static void load_slot_legacy(FILE *f, uint32_t rmagic) {
+    // Read header
+    int fw, fh;
+    fread(&fw, 4, 1, f);
+    fread(&fh, 4, 1, f);
+    if (fw != g.fog.w || fh != g.fog.h) fog_init(fw, fh);
+    fread(&g.grid_size, 4, 1, f);
+    fread(&g.grid_off_x, 4, 1, f);
+    fread(&g.grid_off_y, 4, 1, f);
+    fread(&g.cam[0].target_x, 4, 1, f);
+    fread(&g.cam[0].target_y, 4, 1, f);
+    fread(&g.cam[0].target_zoom, 4, 1, f);
+    g.cam[0].x = g.cam[0].target_x;
+    g.cam[0].y = g.cam[0].target_y;
+    g.cam[0].zoom = g.cam[0].target_zoom;
+    
+    // Version 4 asset table, resolved into the libraries as maps and tokens use it
+    static LoadAsset table[MAX_ASSETS + 1];
+    int table_count = 0;
+    if (rmagic == SAVE_MAGIC_V4) {
+        fread(&table_count, 4, 1, f);
+        if (table_count < 0 || table_count > MAX_ASSETS + 1) table_count = 0;
+        for (int i = 0; i < table_count; i++) {
+            LoadAsset *e = &table[i];
+            int path_len = 0;
+            memset(e, 0, sizeof(*e));
+            e->lib_idx[0] = e->lib_idx[1] = -1;
+            fread(&path_len, 4, 1, f);
+            if (path_len > 0 && path_len < 256) fread(e->path, 1, path_len, f);
+            else fseek(f, path_len, SEEK_CUR);
+            fread(&e->hash, 8, 1, f);
+            if (fread(&e->len, 4, 1, f) != 1 || e->len <= 0 || e->len > 50*1024*1024) {
+                table_count = i;
+                break;
+            }
+            unsigned char *data = malloc(e->len);
+            if (data && (fread(data, 1, e->len, f) != (size_t)e->len || hash_bytes(data, e->len) != e->hash)) {
+                printf("Save asset %s is damaged\n", e->path);
+                free(data);
+                data = NULL;
+            }
+            e->data = data;
+        }
+    }
+    
+    // Read map asset
+    int map_idx = -1;
+    if (rmagic == SAVE_MAGIC_V4) {
+        int ref = -1;
+        fread(&ref, 4, 1, f);
+        if (ref >= 0 && ref < table_count) map_idx = load_asset_index(&table[ref], 0, g.map_assets, &g.map_count);
+    } else if (read_embedded_asset(f, &map_idx, g.map_assets, &g.map_count, MAX_ASSETS) != 0) {
+        map_idx = -1;
+    }
+    if (map_idx >= 0) {
+        g.map_current = map_idx;
+        g.map_w = g.map_assets[map_idx].w;
+        g.map_h = g.map_assets[map_idx].h;
+    }
+    
+    // Read tokens with embedded assets
+    int token_count = 0;
+    fread(&token_count, 4, 1, f);
+    tokens_clear();
+    for (int i = 0; i < token_count; i++) {
+        int slot = token_new();
+        if (slot < 0) break;
+        Token *t = &g.tokens[slot];
+        if (fread(&t->grid_x, 4, 1, f) != 1) {
+            token_delete(slot);
+            break;
+        }
+        fread(&t->grid_y, 4, 1, f);
+        fread(&t->size, 4, 1, f);
+        fread(&t->damage, 4, 1, f);
+        fread(&t->squad, 4, 1, f);
+        fread(&t->rank, 4, 1, f);
+        fread(&t->aura, 4, 1, f);
+        fread(&t->opacity, 1, 1, f);
+        fread(&t->hidden, 1, 1, f);
+        fread(t->cond, 1, COND_COUNT, f);
+        t->selected = false;
+        
+        // Read token image
+        int tok_idx = -1;
+        if (rmagic == SAVE_MAGIC_V4) {
+            int ref = -1;
+            fread(&ref, 4, 1, f);
+            if (ref >= 0 && ref < table_count) tok_idx = load_asset_index(&table[ref], 1, g.token_lib, &g.token_lib_count);
+        } else if (read_embedded_asset(f, &tok_idx, g.token_lib, &g.token_lib_count, MAX_ASSETS) != 0) {
+            tok_idx = -1;
+        }
+        t->image_idx = tok_idx >= 0 ? tok_idx : 0;
+    }
+    for (int i = 0; i < table_count; i++) free((void*)table[i].data);
+    
+    // Read fog data
+    if (g.fog.bits && rmagic != SAVE_MAGIC_V2) {
+        fread(g.fog.bits, sizeof(uint64_t), (size_t)g.fog.stride*g.fog.h, f);
+        fog_mark_dirty(0, 0, g.fog.w, g.fog.h);
+    } else if (g.fog.bits) {
+        uint8_t *row = malloc(g.fog.w);
+        for (int y = 0; row && y < g.fog.h; y++) {
+            if (fread(row, 1, g.fog.w, f) != (size_t)g.fog.w) break;
+            for (int x = 0; x < g.fog.w; x++) fog_set(x, y, row[x] != 0);
+        }
+        free(row);
+    }
+}
+
+// Save files from version 5 are a table of contents followed by chunks. Each chunk has its own
+// version, and records carry their size, so later fields can be appended without breaking older
+// slots: readers zero-fill fields a chunk is too short for and skip what they do not know.
+#define SAVE_CHUNK_ID(a, b, c, d) ((uint32_t)(a) | (uint32_t)(b) << 8 | (uint32_t)(c) << 16 | (uint32_t)(d) << 24)
+#define SAVE_CHUNK_SCENE SAVE_CHUNK_ID('S','C','E','N')
+#define SAVE_CHUNK_TOKENS SAVE_CHUNK_ID('T','O','K','N')
+#define SAVE_CHUNK_DRAWINGS SAVE_CHUNK_ID('D','R','A','W')
+#define SAVE_CHUNK_FOG SAVE_CHUNK_ID('F','O','G',' ')
+#define SAVE_CHUNK_ASSETS SAVE_CHUNK_ID('A','S','E','T')  // Table of paths, hashes and blob ranges
+#define SAVE_CHUNK_BLOBS SAVE_CHUNK_ID('B','L','O','B')   // Original file bytes, read only when used
+#define SAVE_CHUNK_AUTOSAVE SAVE_CHUNK_ID('A','U','T','O')  // Autosave snapshots only: journal generation
+#define SAVE_CHUNK_MAX 16
+
+typedef struct {
+    uint32_t id, version;
+    uint64_t offset, size;
+} SaveChunk;
+
+typedef struct {
+    int fog_w, fog_h, grid_size, grid_off_x, grid_off_y;
+    float cam_x, cam_y, cam_zoom;
+    int map_ref;  // Index into the asset table, -1 for none
+} SaveScene;
+
+typedef struct {
+    int grid_x, grid_y, size, damage, squad, rank, aura;
+    int asset_ref;
+    uint8_t opacity, hidden, cond[COND_COUNT];
+} SaveToken;
+
+typedef struct {
+    int path_len;  // Path bytes follow each entry
+    uint64_t hash;
+    uint64_t blob_offset, blob_size;  // Within the blob chunk
+} SaveAssetEntry;
+
+static void save_chunk_begin(FILE *f, SaveChunk *toc, int *n, uint32_t id) {
+    toc[*n] = (SaveChunk){id, 1, (uint64_t)ftell(f), 0};
+}
+
+static void save_chunk_end(FILE *f, SaveChunk *toc, int *n) {
+    toc[*n].size = (uint64_t)ftell(f) - toc[*n].offset;
+    (*n)++;
+}
+
+// Records of record_size bytes, count in front
+static void save_records(FILE *f, const void *records, int count, int record_size) {
+    fwrite(&count, 4, 1, f);
+    fwrite(&record_size, 4, 1, f);
+    fwrite(records, record_size, count, f);
+}
+
+// Everything a save writes, copied on the main thread so the writer never reads live scene state.
+// Asset bytes are not copied: blobs never change or go away once loaded, and file assets are read
+// by the writer.
+typedef struct {
+    char path[64];
+    SaveScene scene;
+    SaveToken *tokens;  // In drawing order; buffers are kept and grown between saves
+    int token_count, token_cap;
+    Drawing *drawings;
+    int drawing_count, drawing_cap;
+    uint64_t *fog_bits;
+    size_t fog_words;
+    struct { char path[256]; const unsigned char *blob; int blob_len; } assets[MAX_ASSETS + 1];
+    int asset_count;  // Distinct library entries used, tokens and the scene refer to these
+    uint32_t autosave_gen;  // Nonzero for autosave snapshots, see autosave_compact
+} SaveJob;
+
+static SaveJob save_job;  // Owned by the save thread while save_rt.busy is set
+
+static int save_job_asset(SaveJob *job, const Asset *a) {
+    for (int i = 0; i < job->asset_count; i++)
+        if (!strcmp(job->assets[i].path, a->path)) return i;
+    if (job->asset_count == MAX_ASSETS + 1) return -1;
+    int i = job->asset_count++;
+    memcpy(job->assets[i].path, a->path, sizeof(job->assets[i].path));
+    job->assets[i].blob = a->blob;
+    job->assets[i].blob_len = a->blob_len;
+    return i;
+}
+
+// Saved fields of a token; padding is zeroed so equal tokens compare equal with memcmp
+static void save_token_fill(SaveToken *st, const Token *t, int asset_ref) {
+    memset(st, 0, sizeof(*st));
+    st->grid_x = t->grid_x; st->grid_y = t->grid_y; st->size = t->size;
+    st->damage = t->damage; st->squad = t->squad; st->rank = t->rank; st->aura = t->aura;
+    st->asset_ref = asset_ref;
+    st->opacity = t->opacity; st->hidden = t->hidden;
+    for (int c = 0; c < COND_COUNT; c++) st->cond[c] = t->cond[c];
+}
+
+static bool save_snapshot(SaveJob *job, const char *path) {
+    snprintf(job->path, sizeof(job->path), "%s", path);
+    job->asset_count = 0;
+    int map_ref = g.map_current < g.map_count ? save_job_asset(job, &g.map_assets[g.map_current]) : -1;
+    job->scene = (SaveScene){g.fog.w, g.fog.h, g.grid_size, g.grid_off_x, g.grid_off_y,
+                             g.cam[0].target_x, g.cam[0].target_y, g.cam[0].target_zoom, map_ref};
+    if (g.token_pool.count > job->token_cap) {
+        SaveToken *tokens = realloc(job->tokens, g.token_pool.count * sizeof(SaveToken));
+        if (!tokens) return false;
+        job->tokens = tokens;
+        job->token_cap = g.token_pool.count;
+    }
+    job->token_count = 0;
+    POOL_FOR(g.token_pool, i)  // Padding zeroed, so saves are byte-identical for the same scene
+        save_token_fill(&job->tokens[job->token_count++], &g.tokens[i], save_job_asset(job, &g.token_lib[g.tokens[i].image_idx]));
+    job->drawing_count = pool_pack(&g.drawing_pool, (void **)&job->drawings, &job->drawing_cap);
+    if (job->drawing_count < g.drawing_pool.count) return false;
+    job->fog_words = (size_t)g.fog.stride * g.fog.h;
+    job->fog_bits = malloc(job->fog_words * sizeof(uint64_t));
+    if (!job->fog_bits) return false;
+    memcpy(job->fog_bits, g.fog.bits, job->fog_words * sizeof(uint64_t));
+    return true;
+}
+
+static void save_progress(uint64_t done, uint64_t total) {
+    SDL_SetAtomicInt(&save_rt.progress, total ? (int)(done * 1000 / total) : 1000);
+    SDL_Event e = {0};
+    e.type = save_rt.event;
+    if (e.type) SDL_PushEvent(&e);
+}
+
+// Writes a snapshot as a version 5 slot. Runs on the save thread: reads and hashes the asset files,
+// writes to a temporary file and renames it over the slot, so a failed or interrupted save leaves
+// the previous one intact.
+static bool save_write(SaveJob *job) {
+    // Asset table: each distinct image once, as the bytes of its source file
+    static SaveAsset table[MAX_ASSETS + 1];
+    int table_count = 0, remap[MAX_ASSETS + 1];
+    uint64_t total = job->fog_words * sizeof(uint64_t), done = 0;
+    for (int i = 0; i < job->asset_count; i++) {
+        SaveAsset e = {job->assets[i].path, job->assets[i].blob, job->assets[i].blob_len, false, 0};
+        if (!e.data) {
+            e.data = read_file(e.path, &e.len);
+            e.owned = true;
+        }
+        remap[i] = -1;
+        if (!e.data) continue;
+        e.hash = hash_bytes(e.data, e.len);
+        for (int j = 0; j < table_count && remap[i] < 0; j++)
+            if (table[j].hash == e.hash && table[j].len == e.len && !memcmp(table[j].data, e.data, e.len)) remap[i] = j;
+        if (remap[i] >= 0) {
+            if (e.owned) free((void*)e.data);
+            continue;
+        }
+        remap[i] = table_count;
+        table[table_count++] = e;
+        total += e.len;
+    }
+    if (job->scene.map_ref >= 0) job->scene.map_ref = remap[job->scene.map_ref];
+    for (int i = 0; i < job->token_count; i++)
+        if (job->tokens[i].asset_ref >= 0) job->tokens[i].asset_ref = remap[job->tokens[i].asset_ref];
+    
+    char tmp_path[80];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", job->path);
+    FILE *f = fopen(tmp_path, "wb");
+    bool ok = f != NULL;
+    if (f) {
+        uint32_t magic = SAVE_MAGIC;
+        int chunk_count = 0;
+        SaveChunk toc[SAVE_CHUNK_MAX] = {0};
+        fwrite(&magic, 4, 1, f);
+        fwrite(&chunk_count, 4, 1, f);
+        fwrite(toc, sizeof(SaveChunk), SAVE_CHUNK_MAX, f);  // Reserved, rewritten once the chunks are placed
+        
+        save_chunk_begin(f, toc, &chunk_count, SAVE_CHUNK_SCENE);
+        fwrite(&job->scene, sizeof(SaveScene), 1, f);
+        save_chunk_end(f, toc, &chunk_count);
+        
+        save_chunk_begin(f, toc, &chunk_count, SAVE_CHUNK_TOKENS);
+        save_records(f, job->tokens, job->token_count, sizeof(SaveToken));
+        save_chunk_end(f, toc, &chunk_count);
+        
+        save_chunk_begin(f, toc, &chunk_count, SAVE_CHUNK_DRAWINGS);
+        save_records(f, job->drawings, job->drawing_count, sizeof(Drawing));
+        save_chunk_end(f, toc, &chunk_count);
+        
+        save_chunk_begin(f, toc, &chunk_count, SAVE_CHUNK_FOG);
+        fwrite(job->fog_bits, sizeof(uint64_t), job->fog_words, f);
+        save_chunk_end(f, toc, &chunk_count);
+        save_progress(done += job->fog_words * sizeof(uint64_t), total);
+        
+        save_chunk_begin(f, toc, &chunk_count, SAVE_CHUNK_ASSETS);
+        fwrite(&table_count, 4, 1, f);
+        uint64_t blob_offset = 0;
+        for (int i = 0; i < table_count; i++) {
+            SaveAssetEntry e;
+            memset(&e, 0, sizeof(e));
+            e.path_len = (int)strlen(table[i].path);
+            e.hash = table[i].hash;
+            e.blob_offset = blob_offset;
+            e.blob_size = (uint64_t)table[i].len;
+            fwrite(&e, sizeof(e), 1, f);
+            fwrite(table[i].path, 1, e.path_len, f);
+            blob_offset += table[i].len;
+        }
+        save_chunk_end(f, toc, &chunk_count);
+        
+        save_chunk_begin(f, toc, &chunk_count, SAVE_CHUNK_BLOBS);
+        for (int i = 0; i < table_count; i++) {
+            fwrite(table[i].data, 1, table[i].len, f);
+            save_progress(done += table[i].len, total);
+        }
+        save_chunk_end(f, toc, &chunk_count);
+        
+        if (job->autosave_gen) {
+            save_chunk_begin(f, toc, &chunk_count, SAVE_CHUNK_AUTOSAVE);
+            fwrite(&job->autosave_gen, 4, 1, f);
+            save_chunk_end(f, toc, &chunk_count);
+        }
+        
+        fseek(f, 4, SEEK_SET);
+        fwrite(&chunk_count, 4, 1, f);
+        fwrite(toc, sizeof(SaveChunk), chunk_count, f);
+        ok = !ferror(f);
+        ok = fclose(f) == 0 && ok;
+    }
+    for (int i = 0; i < table_count; i++)
+        if (table[i].owned) free((void*)table[i].data);
+    free(job->fog_bits);
+    job->fog_bits = NULL;
+    
+#ifdef _WIN32
+    if (ok) ok = MoveFileExA(tmp_path, job->path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    if (ok) ok = rename(tmp_path, job->path) == 0;
+#endif
+    if (!ok) remove(tmp_path);
+    return ok;
+}
+
+static int save_thread(void *data) {
+    (void)data;
+    save_rt.ok = save_write(&save_job);
+    SDL_SetAtomicInt(&save_rt.busy, 0);
+    save_progress(1, 1);
+    return 0;
+}
+
+// Starts writing the scene to a slot in the background; false if a save is still running. Slot -1
+// with a generation is an autosave snapshot, which the DM panel only shows if it fails.
+static bool save_slot_async(int slot, const char *path, uint32_t autosave_gen) {
+    if (!SDL_CompareAndSwapAtomicInt(&save_rt.busy, 0, 1)) return false;
+    if (!save_rt.event) save_rt.event = SDL_RegisterEvents(1);
+    save_rt.slot = slot;
+    save_rt.reported = false;
+    save_rt.notice_until = 0;
+    SDL_SetAtomicInt(&save_rt.progress, 0);
+    save_job.autosave_gen = autosave_gen;
+    SDL_Thread *t = save_snapshot(&save_job, path) ? SDL_CreateThread(save_thread, "save", NULL) : NULL;
+    if (t) {
+        SDL_DetachThread(t);
+    } else {
+        free(save_job.fog_bits);
+        save_job.fog_bits = NULL;
+        save_rt.ok = false;
+        SDL_SetAtomicInt(&save_rt.busy, 0);
+    }
+    return true;
+}
+
+// Main thread, on save events: logs a finished save once and keeps its result on screen briefly
+static void autosave_compacted(bool ok);
+static void save_slot_manual(int slot);
+
+static void save_check_done(void) {
+    if (save_rt.reported || SDL_GetAtomicInt(&save_rt.busy)) return;
+    save_rt.reported = true;
+    if (save_rt.slot < 0) {
+        autosave_compacted(save_rt.ok);
+        if (!save_rt.ok) save_rt.notice_until = SDL_GetTicks() + 2000;
+        if (save_rt.queued) {
+            int slot = save_rt.queued - 1;
+            save_rt.queued = 0;
+            save_slot_manual(slot);
+        }
+        return;
+    }
+    save_rt.notice_until = SDL_GetTicks() + 2000;
+    if (save_rt.ok) printf("Saved to slot %d\n", save_rt.slot + 1);
+    else printf("Failed to save slot %d\n", save_rt.slot + 1);
+}
+
+// Shift+F1..F9: saves now, or once a running autosave snapshot is written
+static void save_slot_manual(int slot) {
+    char path[64]; snprintf(path, 64, "saves/slot_%d.vtt", slot);
+    if (save_slot_async(slot, path, 0)) save_check_done();  // Reports a save that failed to start
+    else if (save_rt.slot >= 0) printf("Still saving slot %d\n", save_rt.slot + 1);
+    else {
+        save_rt.queued = slot + 1;
+        printf("Slot %d will be saved once the autosave is written\n", slot + 1);
+    }
 }
 
-// Helper for saving embedded PNG data
-// Helper struct for PNG writing
+// Read-only view of a whole file, so save chunks are parsed where they lie
 typedef struct {
-    unsigned char *data;
-    int size;
-    int capacity;
-} PNGBuffer;
+    const unsigned char *data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file, mapping;
+#endif
+} MappedFile;
+
+static bool file_map(const char *path, MappedFile *m) {
+    memset(m, 0, sizeof(*m));
+#ifdef _WIN32
+    m->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m->file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER sz;
+    if (GetFileSizeEx(m->file, &sz) && sz.QuadPart > 0) {
+        m->mapping = CreateFileMappingA(m->file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (m->mapping) m->data = MapViewOfFile(m->mapping, FILE_MAP_READ, 0, 0, 0);
+        m->size = (size_t)sz.QuadPart;
+    }
+    if (!m->data) {
+        if (m->mapping) CloseHandle(m->mapping);
+        CloseHandle(m->file);
+        return false;
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            m->data = p;
+            m->size = (size_t)st.st_size;
+        }
+    }
+    close(fd);  // The mapping stays valid without the descriptor
+    if (!m->data) return false;
+#endif
+    return true;
+}
 
-static void png_write_callback(void *context, void *data, int size) {
-    PNGBuffer *buf = (PNGBuffer*)context;
-    if (buf->size + size > buf->capacity) {
-        buf->capacity = (buf->size + size) * 2;
-        buf->data = realloc(buf->data, buf->capacity);
+static void file_unmap(MappedFile *m) {
+#ifdef _WIN32
+    UnmapViewOfFile(m->data);
+    CloseHandle(m->mapping);
+    CloseHandle(m->file);
+#else
+    munmap((void*)m->data, m->size);
+#endif
+    m->data = NULL;
+}
+
+// A chunk's bytes inside the mapped slot; NULL if the slot has no such chunk or it runs past the end
+static const unsigned char *load_chunk(const MappedFile *m, const SaveChunk *toc, int n, uint32_t id, uint64_t *size) {
+    for (int i = 0; i < n; i++) {
+        if (toc[i].id != id || toc[i].offset > m->size || toc[i].size > m->size - toc[i].offset) continue;
+        *size = toc[i].size;
+        return m->data + toc[i].offset;
     }
-    memcpy(buf->data + buf->size, data, size);
-    buf->size += size;
+    return NULL;
+}
+
+// Record i of a save_records block, zero-filled past the stored record size; false when out of range
+static bool load_record(const unsigned char *chunk, uint64_t size, int i, void *out, int out_size) {
+    int count, record_size;
+    if (size < 8) return false;
+    memcpy(&count, chunk, 4);
+    memcpy(&record_size, chunk + 4, 4);
+    if (i >= count || record_size <= 0 || 8 + (uint64_t)(i + 1) * record_size > size) return false;
+    memset(out, 0, out_size);
+    memcpy(out, chunk + 8 + (uint64_t)i * record_size, SDL_min(record_size, out_size));
+    return true;
+}
+
+// A token from its saved fields, unselected; image_idx < 0 falls back to the first token image
+static void load_token_fill(Token *t, const SaveToken *st, int image_idx) {
+    memset(t, 0, sizeof(*t));
+    t->grid_x = st->grid_x; t->grid_y = st->grid_y; t->size = st->size;
+    t->damage = st->damage; t->squad = st->squad; t->rank = st->rank; t->aura = st->aura;
+    t->opacity = st->opacity; t->hidden = st->hidden;
+    for (int c = 0; c < COND_COUNT; c++) t->cond[c] = st->cond[c];
+    t->image_idx = image_idx >= 0 ? image_idx : 0;
 }
 
-static void write_embedded_asset(FILE *f, Asset *asset) {
-    ensure_asset_loaded(asset);
+// Loads a slot over the current scene. autosave_gen, if given, receives the journal generation of an
+// autosave snapshot (0 for other slots).
+static bool load_slot(const char *path, uint32_t *autosave_gen) {
+    MappedFile m;
+    if (autosave_gen) *autosave_gen = 0;
+    if (!file_map(path, &m)) return false;
+    uint32_t magic = 0;
+    int chunk_count = 0;
+    if (m.size >= 8) {
+        memcpy(&magic, m.data, 4);
+        memcpy(&chunk_count, m.data + 4, 4);
+    }
+    if (magic == SAVE_MAGIC_V4 || magic == SAVE_MAGIC_V3 || magic == SAVE_MAGIC_V2) {
+        file_unmap(&m);
+        FILE *f = fopen(path, "rb");
+        if (!f) return false;
+        fseek(f, 4, SEEK_SET);
+        load_slot_legacy(f, magic);
+        fclose(f);
+        token_index_rebuild();
+        token_hot_rebuild();
+        map_prefetch();
+        return true;
+    }
+    SaveChunk toc[SAVE_CHUNK_MAX];
+    if (magic != SAVE_MAGIC || chunk_count < 0 || chunk_count > SAVE_CHUNK_MAX ||
+        m.size < 8 + (size_t)chunk_count * sizeof(SaveChunk)) {
+        file_unmap(&m);
+        return false;
+    }
+    memcpy(toc, m.data + 8, chunk_count * sizeof(SaveChunk));
     
-    // Write path
-    int path_len = strlen(asset->path);
-    fwrite(&path_len, 4, 1, f);
-    fwrite(asset->path, 1, path_len, f);
+    uint64_t size = 0;
+    SaveScene sc = {0};
+    const unsigned char *chunk = load_chunk(&m, toc, chunk_count, SAVE_CHUNK_SCENE, &size);
+    if (!chunk) {
+        file_unmap(&m);
+        return false;
+    }
+    memcpy(&sc, chunk, SDL_min(size, sizeof(sc)));
+    if (sc.fog_w != g.fog.w || sc.fog_h != g.fog.h) fog_init(sc.fog_w, sc.fog_h);
+    g.grid_size = sc.grid_size;
+    g.grid_off_x = sc.grid_off_x;
+    g.grid_off_y = sc.grid_off_y;
+    g.cam[0].x = g.cam[0].target_x = sc.cam_x;
+    g.cam[0].y = g.cam[0].target_y = sc.cam_y;
+    g.cam[0].zoom = g.cam[0].target_zoom = sc.cam_zoom;
     
-    // Read image from file
-    int w, h;
-    unsigned char *data = stbi_load(asset->path, &w, &h, NULL, 4);
-    if (data) {
-        // Write PNG to memory buffer using callback
-        PNGBuffer buf = {0};
-        buf.capacity = w * h * 4;
-        buf.data = malloc(buf.capacity);
-        
-        if (stbi_write_png_to_func(png_write_callback, &buf, w, h, 4, data, w * 4)) {
-            fwrite(&buf.size, 4, 1, f);
-            fwrite(buf.data, 1, buf.size, f);
-        } else {
-            int zero = 0;
-            fwrite(&zero, 4, 1, f);
+    // Asset table. Entries point into the mapping; load_asset_index copies out the blobs an asset
+    // takes, since the slot file can be overwritten while they wait to be decoded.
+    static LoadAsset table[MAX_ASSETS + 1];
+    int table_count = 0;
+    uint64_t blobs_size = 0;
+    const unsigned char *blobs = load_chunk(&m, toc, chunk_count, SAVE_CHUNK_BLOBS, &blobs_size);
+    const unsigned char *assets = load_chunk(&m, toc, chunk_count, SAVE_CHUNK_ASSETS, &size);
+    if (assets && size >= 4) {
+        int n;
+        memcpy(&n, assets, 4);
+        uint64_t pos = 4;
+        for (int i = 0; i < n && i < MAX_ASSETS + 1 && pos + sizeof(SaveAssetEntry) <= size; i++) {
+            SaveAssetEntry se;
+            memcpy(&se, assets + pos, sizeof(se));
+            pos += sizeof(se);
+            if (se.path_len < 0 || pos + se.path_len > size) break;
+            LoadAsset *e = &table[table_count++];
+            memset(e, 0, sizeof(*e));
+            e->lib_idx[0] = e->lib_idx[1] = -1;
+            memcpy(e->path, assets + pos, SDL_min(se.path_len, 255));
+            pos += se.path_len;
+            e->hash = se.hash;
+            if (!blobs || se.blob_size == 0 || se.blob_size > 50*1024*1024 || se.blob_offset > blobs_size ||
+                se.blob_size > blobs_size - se.blob_offset) continue;
+            if (hash_bytes(blobs + se.blob_offset, se.blob_size) != e->hash) {
+                printf("Save asset %s is damaged\n", e->path);
+                continue;
+            }
+            e->data = blobs + se.blob_offset;
+            e->len = (int)se.blob_size;
         }
-        
-        free(buf.data);
-        stbi_image_free(data);
-    } else {
-        int zero = 0;
-        fwrite(&zero, 4, 1, f);
     }
-}
-
-// Helper for loading embedded PNG data
-static int read_embedded_asset(FILE *f, int *out_idx, Asset *lib, int *lib_count, int max_count) {
-    // Read path
-    int path_len;
-    if (fread(&path_len, 4, 1, f) != 1) return -1;
-    char path[256] = {0};
-    if (path_len > 0 && path_len < 256) {
-        fread(path, 1, path_len, f);
+    
+    if (sc.map_ref >= 0 && sc.map_ref < table_count) {
+        int map_idx = load_asset_index(&table[sc.map_ref], 0, g.map_assets, &g.map_count);
+        if (map_idx >= 0) g.map_current = map_idx;
     }
     
-    // Read PNG data
-    int png_len;
-    if (fread(&png_len, 4, 1, f) != 1) return -1;
-    if (png_len <= 0 || png_len > 50*1024*1024) return -1; // Sanity check: max 50MB
+    chunk = load_chunk(&m, toc, chunk_count, SAVE_CHUNK_TOKENS, &size);
+    tokens_clear();
+    SaveToken st;
+    for (int n = 0; chunk && load_record(chunk, size, n, &st, sizeof(st)); n++) {
+        int tok_idx = st.asset_ref >= 0 && st.asset_ref < table_count ?
+                      load_asset_index(&table[st.asset_ref], 1, g.token_lib, &g.token_lib_count) : -1;
+        int slot = token_new();
+        if (slot < 0) break;
+        load_token_fill(&g.tokens[slot], &st, tok_idx);
+    }
     
-    unsigned char *png_data = malloc(png_len);
-    if (!png_data) return -1;
-    if (fread(png_data, 1, png_len, f) != (size_t)png_len) {
-        free(png_data);
-        return -1;
+    chunk = load_chunk(&m, toc, chunk_count, SAVE_CHUNK_DRAWINGS, &size);
+    drawings_clear();
+    Drawing d;
+    for (int n = 0; chunk && load_record(chunk, size, n, &d, sizeof(d)); n++) {
+        int slot = drawing_new();
+        if (slot < 0) break;
+        g.drawings[slot] = d;
     }
     
-    // Check if asset already exists in library
-    for (int i = 0; i < *lib_count; i++) {
-        if (strcmp(lib[i].path, path) == 0) {
-            free(png_data);
-            *out_idx = i;
-            return 0;
-        }
+    chunk = load_chunk(&m, toc, chunk_count, SAVE_CHUNK_FOG, &size);
+    if (chunk && g.fog.bits && size == (uint64_t)g.fog.stride * g.fog.h * sizeof(uint64_t)) {
+        memcpy(g.fog.bits, chunk, size);
+        fog_mark_dirty(0, 0, g.fog.w, g.fog.h);
     }
     
-    // Add new asset to library
-    if (*lib_count >= max_count) {
-        free(png_data);
-        return -1;
+    chunk = load_chunk(&m, toc, chunk_count, SAVE_CHUNK_AUTOSAVE, &size);
+    if (chunk && autosave_gen && size >= 4) memcpy(autosave_gen, chunk, 4);
+    file_unmap(&m);
+    token_index_rebuild();
+    token_hot_rebuild();
+    
+    // Size is filled in by asset_jobs_finish if the map is still decoding
+    map_prefetch();
+    if (g.map_current < g.map_count) {
+        g.map_w = g.map_assets[g.map_current].w;
+        g.map_h = g.map_assets[g.map_current].h;
+    }
+    return true;
+}
+
+// Autosave: a snapshot in the slot format plus a journal of what changed since it. Every
+// AUTOSAVE_FLUSH_MS the scene is compared with what the journal last recorded and only the
+// differences are appended, so the cost follows the edits rather than the size of the scene.
+// Compaction writes a new snapshot on the save thread and starts the next journal. Snapshots carry
+// a generation and journals are named by theirs; older journals are removed only once the snapshot
+// replacing them is in place, so a crash at any point leaves a snapshot and the journals after it.
+#define AUTOSAVE_DIR "saves"
+#define AUTOSAVE_PATH AUTOSAVE_DIR "/autosave.vtt"
+#define AUTOSAVE_FLUSH_MS 500                  // Edits within this are merged into one set of records
+#define AUTOSAVE_COMPACT_MS (10 * 60 * 1000)   // Age of the oldest journal record before compacting
+#define AUTOSAVE_COMPACT_BYTES (1u << 20)      // Journal size before compacting
+#define AUTOSAVE_RETRY_MS 30000                // After a snapshot could not be written
+#define JOURNAL_MAGIC 0x4A545456  // "VTTJ"
+
+typedef enum {
+    JOURNAL_ASSET = 1,       // JournalAsset, path: token library entry later token records refer to
+    JOURNAL_SCENE,           // JournalScene, map path
+    JOURNAL_TOKEN,           // int index, SaveToken with asset_ref naming a JOURNAL_ASSET; index == count appends
+    JOURNAL_TOKEN_REMOVE,    // int index; later tokens move down
+    JOURNAL_TOKEN_COUNT,     // int count, only ever lower
+    JOURNAL_DRAWING,         // int index, Drawing
+    JOURNAL_DRAWING_REMOVE,
+    JOURNAL_DRAWING_COUNT,
+    JOURNAL_FOG,             // JournalFog, then rows y0..y1 of fog words word0..word1
+} JournalRecord;
+
+typedef struct {
+    uint32_t magic, generation;
+    uint32_t continues;  // Applies after the previous generation's journal, not to a slot loaded over it
+    uint32_t reserved;
+} JournalHeader;
+
+typedef struct {
+    uint32_t type, size;  // Payload bytes follow
+    uint64_t hash;        // Of the payload; replay stops at the first record that does not match
+} JournalRecordHeader;
+
+typedef struct { int id, path_len; } JournalAsset;
+typedef struct { int fog_w, fog_h, grid_size, grid_off_x, grid_off_y, map_path_len; } JournalScene;
+typedef struct { int fog_w, fog_h, y0, y1, word0, word1; } JournalFog;
+
+static struct {
+    bool enabled;
+    FILE *journal;           // NULL until a snapshot has been started to base one on
+    bool chained;            // The next journal can follow on from the current one
+    uint32_t generation;     // Of the current journal and the snapshot it applies to
+    uint32_t oldest;         // Lowest generation whose journal may still be needed
+    uint64_t journal_bytes;
+    uint64_t first_record;   // Ticks when the current journal got its first record, 0 while empty
+    uint64_t next_flush, next_compact;
+    bool pending;            // A view changed since the last flush, so the scene may differ from the journal
+    bool declared[MAX_ASSETS];  // Token library entries written to the current journal
+    // The scene as the journal last recorded it
+    JournalScene scene;
+    char map_path[256];
+    SaveToken *tokens;       // In drawing order, as are the journal's record positions
+    int token_count, token_cap;
+    Drawing *drawings;
+    int drawing_count, drawing_cap;
+    unsigned char *buf;      // Payload staging
+    size_t buf_cap;
+} autosave;
+
+static void autosave_journal_path(char *path, size_t size, uint32_t gen) {
+    snprintf(path, size, AUTOSAVE_DIR "/autosave.%u.journal", gen);
+}
+
+// Removes the journals of generations [from, to)
+static void autosave_remove_journals(uint32_t from, uint32_t to) {
+    DIR *d = opendir(AUTOSAVE_DIR);
+    if (!d) return;
+    struct dirent *e;
+    unsigned gen;
+    char path[300];
+    while ((e = readdir(d))) {
+        if (sscanf(e->d_name, "autosave.%u.journal", &gen) != 1 || gen < from || gen >= to) continue;
+        snprintf(path, sizeof(path), AUTOSAVE_DIR "/%s", e->d_name);
+        remove(path);
+    }
+    closedir(d);
+}
+
+static unsigned char *journal_reserve(size_t size) {
+    if (size > autosave.buf_cap) {
+        unsigned char *buf = realloc(autosave.buf, size);
+        if (!buf) return NULL;
+        autosave.buf = buf;
+        autosave.buf_cap = size;
+    }
+    return autosave.buf;
+}
+
+// Appends the staged payload as one record
+static void journal_commit(uint32_t type, size_t size) {
+    JournalRecordHeader h = {type, (uint32_t)size, hash_bytes(autosave.buf, size)};
+    fwrite(&h, sizeof(h), 1, autosave.journal);
+    fwrite(autosave.buf, 1, size, autosave.journal);
+    autosave.journal_bytes += sizeof(h) + size;
+    if (!autosave.first_record) autosave.first_record = SDL_GetTicks();
+}
+
+// Record made of two parts, e.g. a struct and the path after it
+static void journal_write(uint32_t type, const void *a, size_t a_len, const void *b, size_t b_len) {
+    unsigned char *p = journal_reserve(a_len + b_len);
+    if (!p) return;
+    memcpy(p, a, a_len);
+    if (b_len) memcpy(p + a_len, b, b_len);
+    journal_commit(type, a_len + b_len);
+}
+
+static void autosave_scene_fill(JournalScene *js, char *map_path) {
+    memset(map_path, 0, 256);
+    if (g.map_current < g.map_count) memcpy(map_path, g.map_assets[g.map_current].path, 256);
+    *js = (JournalScene){g.fog.w, g.fog.h, g.grid_size, g.grid_off_x, g.grid_off_y, (int)strlen(map_path)};
+}
+
+// Records that turn the journal's copy of a record array into cur: one remove record for a single
+// deletion (what Delete and a middle click do), otherwise each changed record and the lower count
+static void journal_diff(void **old, int *old_count, int *old_cap, const void *cur, int count, int size,
+                         uint32_t rec, uint32_t rec_remove, uint32_t rec_count) {
+    if (count > *old_cap) {
+        void *grown = realloc(*old, (size_t)count * size);
+        if (!grown) return;  // Retried on the next flush
+        *old = grown;
+        *old_cap = count;
+    }
+    unsigned char *o = *old;
+    const unsigned char *c = cur;
+    int first = 0;
+    while (first < count && first < *old_count && !memcmp(o + (size_t)first * size, c + (size_t)first * size, size)) first++;
+    if (count == *old_count - 1 && !memcmp(o + (size_t)(first + 1) * size, c + (size_t)first * size, (size_t)(count - first) * size)) {
+        journal_write(rec_remove, &first, 4, NULL, 0);
+    } else {
+        for (int i = first; i < count; i++)
+            if (i >= *old_count || memcmp(o + (size_t)i * size, c + (size_t)i * size, size)) journal_write(rec, &i, 4, c + (size_t)i * size, size);
+        if (count < *old_count) journal_write(rec_count, &count, 4, NULL, 0);
+    }
+    memcpy(o, cur, (size_t)count * size);
+    *old_count = count;
+}
+
+// The scene's tokens as journal records, in drawing order
+static int autosave_tokens_fill(SaveToken **buf, int *cap) {
+    if (g.token_pool.count > *cap) {
+        SaveToken *grown = realloc(*buf, g.token_pool.count * sizeof(SaveToken));
+        if (!grown) return -1;
+        *buf = grown;
+        *cap = g.token_pool.count;
+    }
+    int n = 0;
+    POOL_FOR(g.token_pool, i) save_token_fill(&(*buf)[n++], &g.tokens[i], g.tokens[i].image_idx);
+    return n;
+}
+
+// Appends whatever changed since the last flush and hands it to the OS, so it survives the program
+// crashing (not a power cut: nothing here waits for the disk)
+static void autosave_flush(void) {
+    if (!autosave.journal) return;
+    PROFILE_BEGIN(autosave);
+    JournalScene js;
+    char map_path[256];
+    autosave_scene_fill(&js, map_path);
+    if (memcmp(&js, &autosave.scene, sizeof(js)) || strcmp(map_path, autosave.map_path)) {
+        journal_write(JOURNAL_SCENE, &js, sizeof(js), map_path, js.map_path_len);
+        autosave.scene = js;
+        memcpy(autosave.map_path, map_path, sizeof(map_path));
     }
     
-    int idx = *lib_count;
-    if (load_asset_from_memory(png_data, png_len, &lib[idx], path) == 0) {
-        (*lib_count)++;
-        *out_idx = idx;
-        free(png_data);
-        return 0;
+    POOL_FOR(g.token_pool, i) {
+        int idx = g.tokens[i].image_idx;
+        if (!autosave.declared[idx]) {
+            JournalAsset a = {idx, (int)strlen(g.token_lib[idx].path)};
+            journal_write(JOURNAL_ASSET, &a, sizeof(a), g.token_lib[idx].path, a.path_len);
+            autosave.declared[idx] = true;
+        }
     }
+    static SaveToken *tokens;
+    static Drawing *drawings;
+    static int token_cap, drawing_cap;
+    int token_count = autosave_tokens_fill(&tokens, &token_cap);
+    int drawing_count = pool_pack(&g.drawing_pool, (void **)&drawings, &drawing_cap);
+    if (token_count >= 0)
+        journal_diff((void **)&autosave.tokens, &autosave.token_count, &autosave.token_cap, tokens, token_count,
+                     sizeof(SaveToken), JOURNAL_TOKEN, JOURNAL_TOKEN_REMOVE, JOURNAL_TOKEN_COUNT);
+    if (drawing_count == g.drawing_pool.count)
+        journal_diff((void **)&autosave.drawings, &autosave.drawing_count, &autosave.drawing_cap, drawings, drawing_count,
+                     sizeof(Drawing), JOURNAL_DRAWING, JOURNAL_DRAWING_REMOVE, JOURNAL_DRAWING_COUNT);
     
-    free(png_data);
-    return -1;
+    // Fog: the changed rows, trimmed to the words holding changed cells
+    DirtyRect d = g.fog_journal;
+    g.fog_journal = (DirtyRect){0, 0, 0, 0};
+    d.x1 = SDL_min(d.x1, g.fog.w);
+    d.y1 = SDL_min(d.y1, g.fog.h);
+    if (g.fog.bits && d.x0 < d.x1 && d.y0 < d.y1) {
+        JournalFog jf = {g.fog.w, g.fog.h, d.y0, d.y1, d.x0 >> 6, ((d.x1 - 1) >> 6) + 1};
+        size_t row_words = jf.word1 - jf.word0;
+        unsigned char *p = journal_reserve(sizeof(jf) + row_words * (d.y1 - d.y0) * sizeof(uint64_t));
+        if (p) {
+            memcpy(p, &jf, sizeof(jf));
+            p += sizeof(jf);
+            for (int y = d.y0; y < d.y1; y++, p += row_words * sizeof(uint64_t))
+                memcpy(p, fog_row(&g.fog, y) + jf.word0, row_words * sizeof(uint64_t));
+            journal_commit(JOURNAL_FOG, p - autosave.buf);
+        }
+    }
+    fflush(autosave.journal);
+    PROFILE_END(autosave);
+}
+
+// Takes the scene as the new journal's starting point
+static void autosave_capture(void) {
+    autosave_scene_fill(&autosave.scene, autosave.map_path);
+    autosave.token_count = SDL_max(autosave_tokens_fill(&autosave.tokens, &autosave.token_cap), 0);
+    autosave.drawing_count = pool_pack(&g.drawing_pool, (void **)&autosave.drawings, &autosave.drawing_cap);
+    g.fog_journal = (DirtyRect){0, 0, 0, 0};
+    memset(autosave.declared, 0, sizeof(autosave.declared));
+    autosave.journal_bytes = 0;
+    autosave.first_record = 0;
+}
+
+// Starts writing a snapshot of the next generation and switches to that generation's journal. The
+// current journal is flushed first, so the new one carries on exactly where it stops.
+static void autosave_compact(void) {
+    autosave_flush();
+    if (!save_slot_async(-1, AUTOSAVE_PATH, autosave.generation + 1)) return;
+    JournalHeader h = {JOURNAL_MAGIC, ++autosave.generation, autosave.chained, 0};
+    char path[64];
+    autosave_journal_path(path, sizeof(path), h.generation);
+    if (autosave.journal) fclose(autosave.journal);
+    autosave.journal = fopen(path, "wb");
+    if (autosave.journal && fwrite(&h, sizeof(h), 1, autosave.journal) == 1 && fflush(autosave.journal) == 0) {
+        autosave.chained = true;
+    } else {
+        if (autosave.journal) fclose(autosave.journal);
+        autosave.journal = NULL;
+        autosave.chained = false;
+        autosave.next_compact = SDL_GetTicks() + AUTOSAVE_RETRY_MS;
+        printf("Could not write autosave journal %s\n", path);
+    }
+    autosave_capture();
+    save_check_done();  // Reports a snapshot that failed to start
+}
+
+// Main thread, once the snapshot of the current generation is written or has failed
+static void autosave_compacted(bool ok) {
+    if (ok) {
+        autosave_remove_journals(autosave.oldest, autosave.generation);
+        autosave.oldest = autosave.generation;
+    } else {
+        printf("Autosave snapshot failed, keeping the journals\n");
+        autosave.next_compact = SDL_GetTicks() + AUTOSAVE_RETRY_MS;
+    }
+}
+
+// After a slot is loaded over the scene: the journal no longer applies, so the next tick starts
+// a fresh snapshot, which picks up any edits made before it can run
+static void autosave_rebase(void) {
+    if (!autosave.enabled) return;
+    if (autosave.journal) fclose(autosave.journal);
+    autosave.journal = NULL;
+    autosave.chained = false;
+    autosave.next_flush = autosave.next_compact = 0;
+}
+
+// Main loop: flushes at most every AUTOSAVE_FLUSH_MS and compacts once the journal is big or old
+static void autosave_tick(void) {
+    uint64_t now = SDL_GetTicks();
+    if (!autosave.enabled) return;
+    if (g.view_dirty[0] || g.view_dirty[1]) autosave.pending = true;  // Every edit redraws the DM view
+    if (now < autosave.next_flush) return;
+    autosave.next_flush = now + AUTOSAVE_FLUSH_MS;
+    autosave.pending = false;
+    autosave_flush();
+    bool due = !autosave.journal || autosave.journal_bytes > AUTOSAVE_COMPACT_BYTES ||
+               (autosave.first_record && now - autosave.first_record > AUTOSAVE_COMPACT_MS);
+    // A slot save in progress or still on screen goes first
+    if (due && now >= autosave.next_compact && !SDL_GetAtomicInt(&save_rt.busy) && !save_rt.notice_until) autosave_compact();
+}
+
+// Token library index for a path, adding an entry the asset workers decode once a view needs it
+static int token_lib_index(const char *path) {
+    for (int i = 0; i < g.token_lib_count; i++)
+        if (!strcmp(g.token_lib[i].path, path)) return i;
+    if (g.token_lib_count >= MAX_ASSETS) return -1;
+    Asset *slot = &g.token_lib[g.token_lib_count];
+    memset(slot, 0, sizeof(*slot));
+    snprintf(slot->path, sizeof(slot->path), "%s", path);
+    return g.token_lib_count++;
+}
+
+// Pool slot at each journal record position while replaying, in drawing order
+typedef struct { int *slot; int count, cap; } JournalOrder;
+
+static JournalOrder journal_tokens, journal_drawings;
+
+static void journal_order_build(JournalOrder *o, const Pool *p) {
+    o->count = 0;
+    if (p->count > o->cap) {
+        int *slot = realloc(o->slot, p->count * sizeof(int));
+        if (!slot) return;
+        o->slot = slot;
+        o->cap = p->count;
+    }
+    POOL_FOR(*p, i) o->slot[o->count++] = i;
+}
+
+// Appends a new item's slot; false if it could not be tracked
+static bool journal_order_add(JournalOrder *o, int slot) {
+    if (slot < 0) return false;
+    if (o->count == o->cap) {
+        int cap = o->cap ? o->cap * 2 : 64;
+        int *grown = realloc(o->slot, cap * sizeof(int));
+        if (!grown) return false;
+        o->slot = grown;
+        o->cap = cap;
+    }
+    o->slot[o->count++] = slot;
+    return true;
+}
+
+static void journal_order_remove(JournalOrder *o, int index) {
+    memmove(&o->slot[index], &o->slot[index + 1], (o->count - index - 1) * sizeof(int));
+    o->count--;
+}
+
+// Applies one journal record. Records that do not fit the scene are skipped.
+static void journal_apply(uint32_t type, const unsigned char *p, uint32_t size, int *lib_of) {
+    int index = -1;
+    if (size >= 4) memcpy(&index, p, 4);
+    if (type == JOURNAL_ASSET) {
+        JournalAsset a;
+        char path[256] = {0};
+        if (size < sizeof(a)) return;
+        memcpy(&a, p, sizeof(a));
+        if (a.id < 0 || a.id >= MAX_ASSETS || a.path_len < 0 || a.path_len > 255 || sizeof(a) + a.path_len > size) return;
+        memcpy(path, p + sizeof(a), a.path_len);
+        lib_of[a.id] = token_lib_index(path);
+    } else if (type == JOURNAL_SCENE) {
+        JournalScene js;
+        char path[256] = {0};
+        if (size < sizeof(js)) return;
+        memcpy(&js, p, sizeof(js));
+        if (js.map_path_len < 0 || js.map_path_len > 255 || sizeof(js) + js.map_path_len > size) return;
+        memcpy(path, p + sizeof(js), js.map_path_len);
+        if (js.fog_w != g.fog.w || js.fog_h != g.fog.h) fog_init(js.fog_w, js.fog_h);
+        g.grid_size = js.grid_size;
+        g.grid_off_x = js.grid_off_x;
+        g.grid_off_y = js.grid_off_y;
+        for (int i = 0; i < g.map_count; i++) {
+            if (strcmp(g.map_assets[i].path, path)) continue;
+            g.map_current = i;
+            map_prefetch();
+            g.map_w = g.map_assets[i].w;
+            g.map_h = g.map_assets[i].h;
+        }
+    } else if (type == JOURNAL_TOKEN && index >= 0 && index <= journal_tokens.count) {
+        if (index == journal_tokens.count) {
+            int slot = token_new();
+            if (!journal_order_add(&journal_tokens, slot)) {
+                token_delete(slot);
+                return;
+            }
+        }
+        SaveToken st = {0};
+        memcpy(&st, p + 4, SDL_min(size - 4, sizeof(st)));
+        bool known = st.asset_ref >= 0 && st.asset_ref < MAX_ASSETS;
+        load_token_fill(&g.tokens[journal_tokens.slot[index]], &st, known ? lib_of[st.asset_ref] : -1);
+    } else if (type == JOURNAL_TOKEN_REMOVE && index >= 0 && index < journal_tokens.count) {
+        token_delete(journal_tokens.slot[index]);
+        journal_order_remove(&journal_tokens, index);
+    } else if (type == JOURNAL_TOKEN_COUNT && index >= 0 && index <= journal_tokens.count) {
+        while (journal_tokens.count > index) token_delete(journal_tokens.slot[--journal_tokens.count]);
+    } else if (type == JOURNAL_DRAWING && index >= 0 && index <= journal_drawings.count) {
+        if (index == journal_drawings.count) {
+            int slot = drawing_new();
+            if (!journal_order_add(&journal_drawings, slot)) {
+                drawing_delete(slot);
+                return;
+            }
+        }
+        Drawing *d = &g.drawings[journal_drawings.slot[index]];
+        memset(d, 0, sizeof(Drawing));
+        memcpy(d, p + 4, SDL_min(size - 4, sizeof(Drawing)));
+    } else if (type == JOURNAL_DRAWING_REMOVE && index >= 0 && index < journal_drawings.count) {
+        drawing_delete(journal_drawings.slot[index]);
+        journal_order_remove(&journal_drawings, index);
+    } else if (type == JOURNAL_DRAWING_COUNT && index >= 0 && index <= journal_drawings.count) {
+        while (journal_drawings.count > index) drawing_delete(journal_drawings.slot[--journal_drawings.count]);
+    } else if (type == JOURNAL_FOG && size >= sizeof(JournalFog)) {
+        JournalFog jf;
+        memcpy(&jf, p, sizeof(jf));
+        if (!g.fog.bits || jf.fog_w != g.fog.w || jf.fog_h != g.fog.h || jf.y0 < 0 || jf.y0 >= jf.y1 || jf.y1 > g.fog.h ||
+            jf.word0 < 0 || jf.word0 >= jf.word1 || jf.word1 > g.fog.stride) return;
+        size_t row_words = jf.word1 - jf.word0;
+        if (sizeof(jf) + row_words * (jf.y1 - jf.y0) * sizeof(uint64_t) > size) return;
+        p += sizeof(jf);
+        for (int y = jf.y0; y < jf.y1; y++, p += row_words * sizeof(uint64_t))
+            memcpy(fog_row(&g.fog, y) + jf.word0, p, row_words * sizeof(uint64_t));
+        fog_mark_dirty(jf.word0 * 64, jf.y0, SDL_min(jf.word1 * 64, g.fog.w), jf.y1);
+    }
+}
+
+// Replays the journal of one generation; false if it is missing, belongs to another generation or
+// (unless it is the first) was started over a loaded slot rather than following on from the last
+static bool journal_replay(uint32_t gen, bool first, int *records) {
+    char path[64];
+    autosave_journal_path(path, sizeof(path), gen);
+    MappedFile m;
+    if (!file_map(path, &m)) return false;
+    JournalHeader h = {0};
+    if (m.size >= sizeof(h)) memcpy(&h, m.data, sizeof(h));
+    if (h.magic != JOURNAL_MAGIC || h.generation != gen || (!first && !h.continues)) {
+        file_unmap(&m);
+        return false;
+    }
+    int lib_of[MAX_ASSETS];
+    for (int i = 0; i < MAX_ASSETS; i++) lib_of[i] = -1;
+    journal_order_build(&journal_tokens, &g.token_pool);
+    journal_order_build(&journal_drawings, &g.drawing_pool);
+    size_t pos = sizeof(h);
+    while (pos + sizeof(JournalRecordHeader) <= m.size) {
+        JournalRecordHeader rh;
+        memcpy(&rh, m.data + pos, sizeof(rh));
+        pos += sizeof(rh);
+        const unsigned char *p = m.data + pos;
+        if (rh.size > m.size - pos || hash_bytes(p, rh.size) != rh.hash) break;  // Cut short by a crash
+        journal_apply(rh.type, p, rh.size, lib_of);
+        pos += rh.size;
+        (*records)++;
+    }
+    file_unmap(&m);
+    return true;
+}
+
+// Turns autosave on at startup. With restore, the last autosave and its journals are loaded over the
+// scene; otherwise they are discarded. Either way the first tick writes a fresh snapshot.
+static void autosave_start(bool restore) {
+    autosave.enabled = true;
+    uint32_t gen = 0, next = 0;
+    if (!restore) {
+        remove(AUTOSAVE_PATH);
+    } else if (load_slot(AUTOSAVE_PATH, &gen) && gen) {
+        int records = 0;
+        for (next = gen; journal_replay(next, next == gen, &records); next++) {}
+        autosave.generation = next > gen ? next - 1 : gen;
+        autosave.oldest = gen;
+        autosave.chained = next > gen;  // The next journal follows on from the last one replayed
+        printf("Restored autosave with %d changes since its snapshot\n", records);
+    }
+    // Journals outside the restored chain are left over from an older session
+    autosave_remove_journals(0, autosave.oldest);
+    autosave_remove_journals(next, UINT32_MAX);
+    token_index_rebuild();
+    token_hot_rebuild();
+    autosave_capture();
+}
+
+// Marks the views an event can change. Mouse motion only matters while it edits the scene or
+// moves a cursor-following overlay; every other event is treated as changing both views.
+static void mark_views_for_event(const SDL_Event *e) {
+    bool dm = true, player = true;
+    if (e->type == SDL_EVENT_MOUSE_MOTION &&
+        !(g.cal_drag || g.drag_token || g.paint_fog || (e->motion.state & SDL_BUTTON_MASK(3)) || g.measure_active)) {
+        player = false;
+        dm = g.tool == TOOL_FOG || g.draw_shape || g.cond_wheel;
+    }
+    if (dm) g.view_dirty[0] = true;
+    if (player) g.view_dirty[1] = true;
+    if ((dm || player) && !g.input_ns) g.input_ns = e->common.timestamp;
+}
+
+static void app_quit(void) {
+    autosave_flush();
+    while (SDL_GetAtomicInt(&save_rt.busy)) SDL_Delay(10);  // Let a running save finish its rename
+    save_check_done();  // Starts a slot save queued behind the autosave snapshot
+    while (SDL_GetAtomicInt(&save_rt.busy)) SDL_Delay(10);
+    player_thread_stop();
+    if (profiler.tracing) profile_trace_stop();
+    exit(0);
 }
 
 static void handle_input() {
     SDL_Event e;
     while (SDL_PollEvent(&e)) {
-        if (e.type == SDL_EVENT_QUIT) exit(0);
+        mark_views_for_event(&e);
+        if (asset_jobs.event && e.type == asset_jobs.event) asset_jobs_finish();
+        if (save_rt.event && e.type == save_rt.event) save_check_done();
+        if (e.type == SDL_EVENT_QUIT) app_quit();
         
         // Close app if either window's X button is clicked
         if (e.type == SDL_EVENT_WINDOW_CLOSE_REQUESTED) {
             SDL_WindowID closed_window = e.window.windowID;
             if (closed_window == g.dm.id || closed_window == g.player.id) {
-                exit(0);
+                app_quit();
             }
         }
         
@@ -1382,7 +4660,7 @@ static void handle_input() {
             if (!g.dmg_input && !g.cond_wheel) {
                 // Only allow tool switching if no token is selected
                 bool any_selected = false;
-                for (int i = 0; i < g.token_count; i++) {
+                POOL_FOR(g.token_pool, i) {
                     if (g.tokens[i].selected) { any_selected = true; break; }
                 }
                 
@@ -1397,12 +4675,12 @@ static void handle_input() {
             // Q/E cycles token rank when token selected, else cycles squad color
             if (k == SDLK_Q || k == SDLK_E) {
                 bool any_selected = false;
-                for (int i = 0; i < g.token_count; i++) {
+                POOL_FOR(g.token_pool, i) {
                     if (g.tokens[i].selected) { any_selected = true; break; }
                 }
                 if (any_selected) {
                     int delta = (k == SDLK_E) ? 1 : -1;
-                    for (int i = 0; i < g.token_count; i++) {
+                    POOL_FOR(g.token_pool, i) {
                         if (g.tokens[i].selected) {
                             g.tokens[i].rank = (g.tokens[i].rank + delta + RANK_COUNT) % RANK_COUNT;
                         }
@@ -1471,43 +4749,44 @@ static void handle_input() {
             }
             
             if (k == SDLK_DELETE || k == SDLK_BACKSPACE) {
-                for (int i = 0; i < g.token_count; i++) {
+                POOL_FOR(g.token_pool, i) {
                     if (g.tokens[i].selected) {
-                        if (g.tokens[i].damage_tex[0]) SDL_DestroyTexture(g.tokens[i].damage_tex[0]);
-                        if (g.tokens[i].damage_tex[1]) SDL_DestroyTexture(g.tokens[i].damage_tex[1]);
-                        memmove(&g.tokens[i], &g.tokens[i+1], (g.token_count-i-1)*sizeof(Token));
-                        g.token_count--;
+                        token_delete(i);
                         break;
                     }
                 }
             }
             
             if (k == SDLK_H) {
-                for (int i = 0; i < g.token_count; i++) 
-                    if (g.tokens[i].selected) g.tokens[i].hidden = !g.tokens[i].hidden;
+                POOL_FOR(g.token_pool, i) {
+                    if (!g.tokens[i].selected) continue;
+                    g.tokens[i].hidden = !g.tokens[i].hidden;
+                    token_hot_update(i);
+                }
             }
             
             // S toggles aura on selected tokens (1 = adjacent cells, grows with +/-)
             if (k == SDLK_S) {
-                for (int i = 0; i < g.token_count; i++) {
+                POOL_FOR(g.token_pool, i) {
                     if (g.tokens[i].selected) {
                         if (g.tokens[i].aura > 0) g.tokens[i].aura = 0;
                         else g.tokens[i].aura = 1;  // Start with 1 cell radius (3x3 area)
+                        token_hot_update(i);
                     }
                 }
             }
             
             if (k == SDLK_D) {
                 if (g.shift) {
-                    for (int i = 0; i < g.token_count; i++) g.tokens[i].opacity = 255;
+                    POOL_FOR(g.token_pool, i) g.tokens[i].opacity = 255;
                 } else {
-                    for (int i = 0; i < g.token_count; i++) 
+                    POOL_FOR(g.token_pool, i) 
                         if (g.tokens[i].selected) g.tokens[i].opacity = (g.tokens[i].opacity == 255) ? 128 : 255;
                 }
             }
             
             if (k == SDLK_RETURN && !g.dmg_input) {
-                for (int i = 0; i < g.token_count; i++) {
+                POOL_FOR(g.token_pool, i) {
                     if (g.tokens[i].selected) { 
                         g.dmg_input = true; 
                         g.dmg_buf[0] = 0; 
@@ -1519,10 +4798,11 @@ static void handle_input() {
                 if (k == SDLK_RETURN) {
                     int val = atoi(g.dmg_buf);
                     if (g.shift) val = -val;
-                    for (int i = 0; i < g.token_count; i++) {
+                    POOL_FOR(g.token_pool, i) {
                         if (g.tokens[i].selected) {
                             g.tokens[i].damage += val;
                             if (g.tokens[i].damage < 0) g.tokens[i].damage = 0;
+                            token_hot_update(i);
                         }
                     }
                     g.dmg_input = false;
@@ -1541,7 +4821,7 @@ static void handle_input() {
             }
             
             if (k == SDLK_A && !g.cond_wheel) {
-                for (int i = 0; i < g.token_count; i++) {
+                POOL_FOR(g.token_pool, i) {
                     if (g.tokens[i].selected) { g.cond_wheel = true; g.cond_token_idx = i; break; }
                 }
             } else if (g.cond_wheel && k == SDLK_ESCAPE) {
@@ -1555,118 +4835,13 @@ static void handle_input() {
             if (k >= SDLK_F1 && k <= SDLK_F9) {
                 int slot = k - SDLK_F1;
                 char path[64]; snprintf(path, 64, "saves/slot_%d.vtt", slot);
-                uint32_t magic = SAVE_MAGIC;
                 if (g.shift) {
-                    // SAVE
-                    FILE *f = fopen(path, "wb");
-                    if (f) {
-                        // Write header
-                        fwrite(&magic, 4, 1, f);
-                        fwrite(&g.fog_w, 4, 1, f);
-                        fwrite(&g.fog_h, 4, 1, f);
-                        fwrite(&g.grid_size, 4, 1, f);
-                        fwrite(&g.grid_off_x, 4, 1, f);
-                        fwrite(&g.grid_off_y, 4, 1, f);
-                        fwrite(&g.cam[0].target_x, 4, 1, f);
-                        fwrite(&g.cam[0].target_y, 4, 1, f);
-                        fwrite(&g.cam[0].target_zoom, 4, 1, f);
-                        
-                        // Write embedded map asset
-                        if (g.map_current < g.map_count) {
-                            write_embedded_asset(f, &g.map_assets[g.map_current]);
-                        } else {
-                            int zero = 0;
-                            fwrite(&zero, 4, 1, f);
-                            fwrite(&zero, 4, 1, f);
-                        }
-                        
-                        // Write token count and tokens with embedded assets
-                        fwrite(&g.token_count, 4, 1, f);
-                        for (int i = 0; i < g.token_count; i++) {
-                            Token *t = &g.tokens[i];
-                            fwrite(&t->grid_x, 4, 1, f);
-                            fwrite(&t->grid_y, 4, 1, f);
-                            fwrite(&t->size, 4, 1, f);
-                            fwrite(&t->damage, 4, 1, f);
-                            fwrite(&t->squad, 4, 1, f);
-                            fwrite(&t->rank, 4, 1, f);
-                            fwrite(&t->aura, 4, 1, f);
-                            fwrite(&t->opacity, 1, 1, f);
-                            fwrite(&t->hidden, 1, 1, f);
-                            fwrite(t->cond, 1, COND_COUNT, f);
-                            
-                            // Write embedded token image
-                            write_embedded_asset(f, &g.token_lib[t->image_idx]);
-                        }
-                        
-                        // Write fog data
-                        fwrite(g.fog, 1, g.fog_w*g.fog_h, f);
-                        fclose(f);
-                        printf("Saved to slot %d\n", slot + 1);
-                    }
-                } else {
-                    // LOAD
-                    FILE *f = fopen(path, "rb");
-                    if (f) {
-                        uint32_t rmagic;
-                        fread(&rmagic, 4, 1, f);
-                        if (rmagic == SAVE_MAGIC) {
-                            // Read header
-                            int fw, fh;
-                            fread(&fw, 4, 1, f);
-                            fread(&fh, 4, 1, f);
-                            if (fw != g.fog_w || fh != g.fog_h) fog_init(fw, fh);
-                            fread(&g.grid_size, 4, 1, f);
-                            fread(&g.grid_off_x, 4, 1, f);
-                            fread(&g.grid_off_y, 4, 1, f);
-                            fread(&g.cam[0].target_x, 4, 1, f);
-                            fread(&g.cam[0].target_y, 4, 1, f);
-                            fread(&g.cam[0].target_zoom, 4, 1, f);
-                            g.cam[0].x = g.cam[0].target_x;
-                            g.cam[0].y = g.cam[0].target_y;
-                            g.cam[0].zoom = g.cam[0].target_zoom;
-                            
-                            // Read embedded map asset
-                            int map_idx;
-                            if (read_embedded_asset(f, &map_idx, g.map_assets, &g.map_count, MAX_ASSETS) == 0) {
-                                g.map_current = map_idx;
-                                g.map_w = g.map_assets[map_idx].w;
-                                g.map_h = g.map_assets[map_idx].h;
-                            }
-                            
-                            // Read tokens with embedded assets
-                            fread(&g.token_count, 4, 1, f);
-                            for (int i = 0; i < g.token_count && i < MAX_TOKENS; i++) {
-                                Token *t = &g.tokens[i];
-                                fread(&t->grid_x, 4, 1, f);
-                                fread(&t->grid_y, 4, 1, f);
-                                fread(&t->size, 4, 1, f);
-                                fread(&t->damage, 4, 1, f);
-                                fread(&t->squad, 4, 1, f);
-                                fread(&t->rank, 4, 1, f);
-                                fread(&t->aura, 4, 1, f);
-                                fread(&t->opacity, 1, 1, f);
-                                fread(&t->hidden, 1, 1, f);
-                                fread(t->cond, 1, COND_COUNT, f);
-                                t->selected = false;
-                                t->damage_tex[0] = t->damage_tex[1] = NULL;
-                                t->cached_dmg[0] = t->cached_dmg[1] = -1;
-                                
-                                // Read embedded token image
-                                int tok_idx;
-                                if (read_embedded_asset(f, &tok_idx, g.token_lib, &g.token_lib_count, MAX_ASSETS) == 0) {
-                                    t->image_idx = tok_idx;
-                                } else {
-                                    t->image_idx = 0;
-                                }
-                            }
-                            
-                            // Read fog data
-                            if (g.fog) fread(g.fog, 1, g.fog_w*g.fog_h, f);
-                            printf("Loaded from slot %d\n", slot + 1);
-                        }
-                        fclose(f);
-                    }
+                    save_slot_manual(slot);
+                } else if (load_slot(path, NULL)) {
+                    if (save_rt.queued) printf("Dropped the queued save to slot %d\n", save_rt.queued);
+                    save_rt.queued = 0;
+                    autosave_rebase();
+                    printf("Loaded from slot %d\n", slot + 1);
                 }
             }
             
@@ -1674,18 +4849,24 @@ static void handle_input() {
                 if (g.shift) g.map_current = (g.map_current - 1 + g.map_count) % g.map_count;
                 else g.map_current = (g.map_current + 1) % g.map_count;
                 if (g.map_current < g.map_count) {
-                    ensure_asset_loaded(&g.map_assets[g.map_current]);
+                    // Size is filled in by asset_jobs_finish if the map is still decoding
+                    map_prefetch();
                     g.map_w = g.map_assets[g.map_current].w;
                     g.map_h = g.map_assets[g.map_current].h;
                 }
             }
             
             if (k == SDLK_P) g.sync_views = !g.sync_views;
+            if (k == SDLK_V) {
+                static const char *fog_render_names[FOG_RENDER_COUNT] = {"merged rects", "mask texture", "soft edges"};
+                g.fog_render = (g.fog_render + 1) % FOG_RENDER_COUNT;
+                printf("Fog rendering: %s\n", fog_render_names[g.fog_render]);
+            }
             if (k == SDLK_G) g.show_grid = !g.show_grid;
             
             if (k == SDLK_F10) {
-                // Zoom to fit map perfectly in player window
-                if (g.map_current < g.map_count) {
+                // Zoom to fit map perfectly in player window (once its size is known)
+                if (g.map_current < g.map_count && g.map_w > 0 && g.map_h > 0) {
                     Window *win = &g.player;
                     Camera *cam = &g.cam[0];
                     
@@ -1733,7 +4914,9 @@ static void handle_input() {
                 }
             }
             
-            if (k == SDLK_F12) {
+            if (k == SDLK_F12 && g.shift) {
+                if (profiler.tracing) profile_trace_stop(); else profile_trace_start();
+            } else if (k == SDLK_F12) {
                 // Toggle profiler overlay
                 profiler.show_overlay = !profiler.show_overlay;
                 printf("\n[Profiler %s]\n", profiler.show_overlay ? "ENABLED" : "DISABLED");
@@ -1741,7 +4924,7 @@ static void handle_input() {
 
             
             if (k == SDLK_X && g.tool == TOOL_DRAW) {
-                g.drawing_count = 0;
+                drawings_clear();
             }
             
             if ((k == SDLK_EQUALS || k == SDLK_KP_PLUS)) {
@@ -1751,16 +4934,21 @@ static void handle_input() {
                 } else {
                     // Check if any selected token has an aura - grow aura if so
                     bool has_aura = false;
-                    for (int i = 0; i < g.token_count; i++) {
+                    POOL_FOR(g.token_pool, i) {
                         if (g.tokens[i].selected && g.tokens[i].aura > 0) {
                             g.tokens[i].aura++;
+                            token_hot_update(i);
                             has_aura = true;
                         }
                     }
                     // Otherwise resize selected tokens
                     if (!has_aura) {
-                        for (int i = 0; i < g.token_count; i++) 
-                            if (g.tokens[i].selected && g.tokens[i].size < 4) g.tokens[i].size++;
+                        POOL_FOR(g.token_pool, i) {
+                            if (!g.tokens[i].selected || g.tokens[i].size >= 4) continue;
+                            g.tokens[i].size++;
+                            token_index_update(i);
+                            token_hot_update(i);
+                        }
                     }
                 }
             }
@@ -1771,16 +4959,21 @@ static void handle_input() {
                 } else {
                     // Check if any selected token has an aura - shrink aura if so
                     bool has_aura = false;
-                    for (int i = 0; i < g.token_count; i++) {
+                    POOL_FOR(g.token_pool, i) {
                         if (g.tokens[i].selected && g.tokens[i].aura > 0) {
                             has_aura = true;
                             if (g.tokens[i].aura > 1) g.tokens[i].aura--;
+                            token_hot_update(i);
                         }
                     }
                     // Otherwise resize selected tokens
                     if (!has_aura) {
-                        for (int i = 0; i < g.token_count; i++) 
-                            if (g.tokens[i].selected && g.tokens[i].size > 1) g.tokens[i].size--;
+                        POOL_FOR(g.token_pool, i) {
+                            if (!g.tokens[i].selected || g.tokens[i].size <= 1) continue;
+                            g.tokens[i].size--;
+                            token_index_update(i);
+                            token_hot_update(i);
+                        }
                     }
                 }
             }
@@ -1788,26 +4981,28 @@ static void handle_input() {
             if (!g.dmg_input && k >= SDLK_1 && k <= SDLK_9) {
                 int dmg = (k - SDLK_0);
                 if (g.shift) dmg = -dmg;
-                for (int i = 0; i < g.token_count; i++) {
+                POOL_FOR(g.token_pool, i) {
                     if (g.tokens[i].selected) {
                         g.tokens[i].damage += dmg;
                         if (g.tokens[i].damage < 0) g.tokens[i].damage = 0;
+                        token_hot_update(i);
                     }
                 }
             }
             if (!g.dmg_input && k == SDLK_0) {
                 int dmg = 10;
                 if (g.shift) dmg = -10;
-                for (int i = 0; i < g.token_count; i++) {
+                POOL_FOR(g.token_pool, i) {
                     if (g.tokens[i].selected) {
                         g.tokens[i].damage += dmg;
                         if (g.tokens[i].damage < 0) g.tokens[i].damage = 0;
+                        token_hot_update(i);
                     }
                 }
             }
             
             if (k == SDLK_ESCAPE && !g.cond_wheel && !g.dmg_input) {
-                for (int i = 0; i < g.token_count; i++) g.tokens[i].selected = false;
+                tokens_deselect();
             }
         }
         
@@ -1850,55 +5045,55 @@ static void handle_input() {
                     float dx = mx - cx, dy = my - cy;
                     float dist = sqrtf(dx*dx + dy*dy);
                     
-                    if (dist >= inner_radius && dist <= radius && g.cond_token_idx >= 0) {
+                    if (dist >= inner_radius && dist <= radius && pool_live(&g.token_pool, g.cond_token_idx)) {
                         float angle = atan2f(dy, dx);
                         if (angle < 0) angle += 6.28318f;
                         float segment_angle = 6.28318f / COND_COUNT;
                         int clicked_index = (int)(angle / segment_angle);
                         if (clicked_index >= 0 && clicked_index < COND_COUNT) {
                             g.tokens[g.cond_token_idx].cond[clicked_index] = !g.tokens[g.cond_token_idx].cond[clicked_index];
+                            token_hot_update(g.cond_token_idx);
                         }
                     }
                 } else if (g.tool == TOOL_SELECT) {
-                    Token *hit = NULL;
-                    int hit_idx = -1;
-                    for (int i = g.token_count-1; i >= 0; i--) {
-                        if (g.tokens[i].grid_x == gx && g.tokens[i].grid_y == gy) {
-                            hit = &g.tokens[i];
-                            hit_idx = i;
-                            break;
-                        }
+                    int hit_idx = token_at(gx, gy);
+                    bool hit = hit_idx >= 0;
+                    if (hit) {  // Large tokens can be grabbed by any cell and keep that offset while dragged
+                        g.drag_off_x = g.tokens[hit_idx].grid_x - gx;
+                        g.drag_off_y = g.tokens[hit_idx].grid_y - gy;
                     }
                     
-                    if (hit && (g.shift || g.ctrl) && g.token_count < MAX_TOKENS) {
-                        for (int j = 0; j < g.token_count; j++) g.tokens[j].selected = false;
-                        g.tokens[g.token_count] = *hit;
-                        g.tokens[g.token_count].selected = true;
-                        g.tokens[g.token_count].damage_tex[0] = g.tokens[g.token_count].damage_tex[1] = NULL;
-                        g.tokens[g.token_count].cached_dmg[0] = g.tokens[g.token_count].cached_dmg[1] = -1;
-                        g.tokens[g.token_count].aura = 0;  // Reset aura on duplicate
-                        g.tokens[g.token_count].grid_x = gx;
-                        g.tokens[g.token_count].grid_y = gy;
+                    int dup = hit && (g.shift || g.ctrl) ? token_new() : -1;
+                    if (dup >= 0) {
+                        tokens_deselect();
+                        g.tokens[dup] = g.tokens[hit_idx];
+                        g.tokens[dup].selected = true;
+                        g.tokens[dup].aura = 0;  // Reset aura on duplicate
+                        token_index_add(dup);
+                        token_hot_update(dup);
                         g.drag_token = true;
-                        g.drag_idx = g.token_count++;
+                        g.drag_idx = dup;
                     } else if (hit) {
-                        if (!g.shift && !g.ctrl) 
-                            for (int j = 0; j < g.token_count; j++) g.tokens[j].selected = false;
+                        if (!g.shift && !g.ctrl) tokens_deselect();
                         g.tokens[hit_idx].selected = true;
+                        token_hot_update(hit_idx);
                         g.drag_token = true;
                         g.drag_idx = hit_idx;
                     } else {
-                        for (int j = 0; j < g.token_count; j++) g.tokens[j].selected = false;
+                        tokens_deselect();
                     }
+                } else if (g.tool == TOOL_FOG && g.ctrl) {
+                    fog_flood(gx, gy, !fog_get(gx, gy));
                 } else if (g.tool == TOOL_FOG) {
                     g.paint_fog = true;
                     g.fog_mode = fog_get(gx, gy);
                     fog_paint_brush(gx, gy, !g.fog_mode, g.fog_brush_size);
                 } else if (g.tool == TOOL_SQUAD) {
-                    for (int i = 0; i < g.token_count; i++) {
-                        if (g.tokens[i].grid_x == gx && g.tokens[i].grid_y == gy) {
-                            g.tokens[i].squad = (g.tokens[i].squad == g.current_squad) ? -1 : g.current_squad;
-                        }
+                    const int *hits;
+                    int n = token_index_query(gx, gy, gx + 1, gy + 1, &hits);
+                    for (int k = 0; k < n; k++) {
+                        Token *t = &g.tokens[hits[k]];
+                        t->squad = (t->squad == g.current_squad) ? -1 : g.current_squad;
                     }
                 } else if (g.tool == TOOL_DRAW) {
                     g.draw_shape = true;
@@ -1910,21 +5105,19 @@ static void handle_input() {
             } else if (e.button.button == 2 && g.tool == TOOL_DRAW) {
                 int wx = (int)(mx/g.cam[0].zoom + g.cam[0].x);
                 int wy = (int)(my/g.cam[0].zoom + g.cam[0].y);
-                for (int i = g.drawing_count-1; i >= 0; i--) {
+                for (int i = g.drawing_pool.tail; i >= 0; i = g.drawing_pool.prev[i]) {
                     Drawing *d = &g.drawings[i];
                     if (d->type == SHAPE_RECT) {
                         if (wx >= fmin(d->x1,d->x2) && wx <= fmax(d->x1,d->x2) &&
                             wy >= fmin(d->y1,d->y2) && wy <= fmax(d->y1,d->y2)) {
-                            memmove(&g.drawings[i], &g.drawings[i+1], (g.drawing_count-i-1)*sizeof(Drawing));
-                            g.drawing_count--;
+                            drawing_delete(i);
                             break;
                         }
                     } else {
                         int cx = (d->x1+d->x2)/2, cy = (d->y1+d->y2)/2;
                         int r2 = ((d->x2-d->x1)*(d->x2-d->x1) + (d->y2-d->y1)*(d->y2-d->y1))/4;
                         if ((wx-cx)*(wx-cx) + (wy-cy)*(wy-cy) <= r2) {
-                            memmove(&g.drawings[i], &g.drawings[i+1], (g.drawing_count-i-1)*sizeof(Drawing));
-                            g.drawing_count--;
+                            drawing_delete(i);
                             break;
                         }
                     }
@@ -1937,12 +5130,13 @@ static void handle_input() {
                 g.cal_drag = false;
             } else if (e.button.button == 1) {
                 g.drag_token = false;
-                if (g.draw_shape && g.drawing_count < MAX_DRAWINGS) {
+                if (g.draw_shape) {
                     float mx = e.button.x, my = e.button.y;
                     int ex = (int)(mx/g.cam[0].zoom + g.cam[0].x);
                     int ey = (int)(my/g.cam[0].zoom + g.cam[0].y);
-                    if (abs(ex - g.paint_start_x) > 5 || abs(ey - g.paint_start_y) > 5) {
-                        Drawing *d = &g.drawings[g.drawing_count++];
+                    int slot = abs(ex - g.paint_start_x) > 5 || abs(ey - g.paint_start_y) > 5 ? drawing_new() : -1;
+                    if (slot >= 0) {
+                        Drawing *d = &g.drawings[slot];
                         d->type = g.current_shape;
                         d->x1 = g.paint_start_x; d->y1 = g.paint_start_y;
                         d->x2 = ex; d->y2 = ey;
@@ -1959,11 +5153,16 @@ static void handle_input() {
             if (g.cal_drag) {
                 g.cal_x2 = (int)(mx/g.cam[0].zoom + g.cam[0].x);
                 g.cal_y2 = (int)(my/g.cam[0].zoom + g.cam[0].y);
-            } else if (g.drag_token && g.drag_idx >= 0) {
+            } else if (g.drag_token && pool_live(&g.token_pool, g.drag_idx)) {
                 int gx, gy; 
                 screen_to_grid(mx, my, &g.cam[0], &gx, &gy);
-                g.tokens[g.drag_idx].grid_x = gx;
-                g.tokens[g.drag_idx].grid_y = gy;
+                Token *t = &g.tokens[g.drag_idx];
+                if (t->grid_x != gx + g.drag_off_x || t->grid_y != gy + g.drag_off_y) {
+                    t->grid_x = gx + g.drag_off_x;
+                    t->grid_y = gy + g.drag_off_y;
+                    token_index_update(g.drag_idx);
+                    token_hot_update(g.drag_idx);
+                }
             } else if (g.paint_fog) {
                 int gx, gy; 
                 screen_to_grid(mx, my, &g.cam[0], &gx, &gy);
@@ -1982,33 +5181,281 @@ static void handle_input() {
         }
         
         if (e.type == SDL_EVENT_DROP_FILE) {
-            if (is_image(e.drop.data) && g.token_count < MAX_TOKENS) {
+            if (is_image(e.drop.data)) {
                 float mx, my;
                 SDL_GetMouseState(&mx, &my);
                 int gx, gy; 
                 screen_to_grid(mx, my, &g.cam[0], &gx, &gy);
-                int idx = find_or_load_token_image(e.drop.data);
-                if (idx >= 0) {
-                    Token *t = &g.tokens[g.token_count++];
-                    memset(t, 0, sizeof(Token));
+                // The workers decode the image; the token shows once it is ready
+                int idx = token_lib_index(e.drop.data);
+                if (idx >= 0) asset_request(&g.token_lib[idx], true);
+                int slot = idx >= 0 ? token_new() : -1;
+                if (slot >= 0) {
+                    Token *t = &g.tokens[slot];
                     t->grid_x = gx; t->grid_y = gy; t->size = 1;
                     t->image_idx = idx; t->opacity = 255;
                     t->squad = -1;
+                    token_index_add(slot);
+                    token_hot_update(slot);
                 }
             }
         }
     }
 }
 
+#define IDLE_WAIT_MS 1000  // Upper bound on blocking while idle; wakeups come from events
+
+// Idle waits end in time for a pending autosave flush, so the last edit reaches the journal
+// within AUTOSAVE_FLUSH_MS
+static int32_t idle_wait_ms(void) {
+    if (!autosave.enabled || !autosave.pending) return IDLE_WAIT_MS;
+    uint64_t now = SDL_GetTicks();
+    return now < autosave.next_flush ? (int32_t)SDL_min(autosave.next_flush - now, IDLE_WAIT_MS) : 0;
+}
+
+static bool views_active(void) {
+    if (profiler.show_overlay) g.view_dirty[0] = true;  // Keeps the graph moving while the scene is idle
+    for (int v = 0; v < 2; v++) {
+        const Camera *c = &g.cam[v];
+        if (g.view_dirty[v] || c->x != c->target_x || c->y != c->target_y || c->zoom != c->target_zoom) return true;
+    }
+    return false;
+}
+
+// Frame period of the display the DM window is on, 60 Hz if unknown
+static uint64_t frame_period_ns(void) {
+    const SDL_DisplayMode *mode = SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(g.dm.win));
+    float hz = (mode && mode->refresh_rate > 0) ? mode->refresh_rate : 60.0f;
+    return (uint64_t)(1e9 / hz);
+}
+
+// Headless benchmark (--bench): synthetic scene rendered offscreen, per-zone timings written as CSV (--bench-csv file, else stdout)
+#define BENCH_MAP_SIZE 4096
+
+typedef struct {
+    bool enabled;
+    int frames, tokens, drawings;
+    const char *csv_path;  // CSV destination, stdout if NULL
+} BenchOptions;
+
+static uint32_t bench_seed = 12345;
+
+static int bench_rand(int n) {  // Fixed LCG so every run draws the same scene
+    bench_seed = bench_seed * 1664525u + 1013904223u;
+    return (int)((bench_seed >> 8) % (uint32_t)n);
+}
+
+static void bench_build_scene(const BenchOptions *opt) {
+    // Map: gradient with a darker checker every grid cell
+    unsigned char *pixels = malloc((size_t)BENCH_MAP_SIZE * BENCH_MAP_SIZE * 4);
+    if (pixels) {
+        for (int y = 0; y < BENCH_MAP_SIZE; y++) {
+            for (int x = 0; x < BENCH_MAP_SIZE; x++) {
+                unsigned char *p = &pixels[((size_t)y * BENCH_MAP_SIZE + x) * 4];
+                int checker = ((x >> 6) + (y >> 6)) & 1 ? 40 : 0;
+                p[0] = (unsigned char)(60 + (x >> 5) - checker / 2);
+                p[1] = (unsigned char)(90 + (y >> 5) - checker);
+                p[2] = (unsigned char)(70 - checker / 2);
+                p[3] = 255;
+            }
+        }
+        PixelEntry *p = pixel_cache_insert("bench_map", pixels, BENCH_MAP_SIZE, BENCH_MAP_SIZE);
+        if (p && load_asset_from_pixels(p, &g.map_assets[0], "bench_map") == 0) g.map_count = 1;
+        pixel_cache_release(p);
+    }
+    g.map_current = 0;
+    g.map_w = g.map_h = BENCH_MAP_SIZE;
+    g.grid_size = 64;
+    g.grid_off_x = g.grid_off_y = 0;
+    fog_init(BENCH_MAP_SIZE / 64, BENCH_MAP_SIZE / 64);
+    
+    // Token images: filled discs in four colors
+    static const SDL_Color disc_cols[4] = {{200,60,60,255}, {60,120,220,255}, {60,180,80,255}, {220,200,60,255}};
+    const int ts = 128;
+    for (int i = 0; i < 4; i++) {
+        pixels = malloc((size_t)ts * ts * 4);
+        if (!pixels) break;
+        for (int y = 0; y < ts; y++) {
+            for (int x = 0; x < ts; x++) {
+                float dx = x - ts / 2 + 0.5f, dy = y - ts / 2 + 0.5f;
+                float a = fminf(fmaxf(ts / 2 - sqrtf(dx*dx + dy*dy), 0.0f), 1.0f);
+                unsigned char *p = &pixels[(y * ts + x) * 4];
+                p[0] = disc_cols[i].r; p[1] = disc_cols[i].g; p[2] = disc_cols[i].b;
+                p[3] = (unsigned char)(a * 255);
+            }
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "bench_token_%d", i);
+        PixelEntry *p = pixel_cache_insert(name, pixels, ts, ts);
+        if (p && load_asset_from_pixels(p, &g.token_lib[i], name) == 0) g.token_lib_count = i + 1;
+        pixel_cache_release(p);
+    }
+    
+    int cells = BENCH_MAP_SIZE / 64;
+    tokens_clear();
+    for (int i = 0; i < opt->tokens && g.token_lib_count > 0; i++) {
+        int slot = token_new();
+        if (slot < 0) break;
+        Token *t = &g.tokens[slot];
+        t->grid_x = bench_rand(cells);
+        t->grid_y = bench_rand(cells);
+        t->size = 1 + (bench_rand(8) == 0);
+        t->image_idx = bench_rand(g.token_lib_count);
+        t->damage = bench_rand(3) == 0 ? bench_rand(40) : 0;
+        t->squad = bench_rand(9) - 1;
+        t->opacity = bench_rand(5) == 0 ? 128 : 255;
+        t->hidden = bench_rand(10) == 0;
+        t->rank = bench_rand(RANK_COUNT);
+        t->aura = bench_rand(6) == 0 ? 1 + bench_rand(2) : 0;
+        for (int c = 0; c < COND_COUNT; c++) t->cond[c] = bench_rand(4) == 0;
+    }
+    if (g.token_pool.head >= 0) g.tokens[g.token_pool.head].selected = true;
+    token_index_rebuild();
+    token_hot_rebuild();
+    
+    drawings_clear();
+    for (int i = 0; i < opt->drawings; i++) {
+        int slot = drawing_new();
+        if (slot < 0) break;
+        Drawing *d = &g.drawings[slot];
+        d->type = bench_rand(2) ? SHAPE_RECT : SHAPE_CIRCLE;
+        d->x1 = bench_rand(BENCH_MAP_SIZE);
+        d->y1 = bench_rand(BENCH_MAP_SIZE);
+        d->x2 = d->x1 + 64 + bench_rand(512);
+        d->y2 = d->y1 + 64 + bench_rand(512);
+        d->color = bench_rand(8);
+    }
+    
+    // Fog: everything hidden, then revealed rooms joined by corridors
+    fog_fill_rect(0, 0, cells, cells, false);
+    int px = cells / 2, py = cells / 2;
+    for (int i = 0; i < 40; i++) {
+        int x = bench_rand(cells), y = bench_rand(cells);
+        fog_fill_rect(x, y, x + 3 + bench_rand(10), y + 3 + bench_rand(10), true);
+        fog_fill_rect(px < x ? px : x, py, (px < x ? x : px) + 1, py + 1, true);
+        fog_fill_rect(x, py < y ? py : y, x + 1, (py < y ? y : py) + 1, true);
+        px = x; py = y;
+    }
+}
+
+static void bench_print_stats(FILE *out, const char *mode, const char *thread, const char *zone, const float *ring, const float *self) {
+    ProfileStats s = profile_stats(ring);
+    if (s.n == 0) return;
+    ProfileStats ss = self ? profile_stats(self) : s;
+    fprintf(out, "%s,%s,%s,%d,%.4f,%.4f,%.4f,%.4f,%.4f\n", mode, thread, zone, s.n, s.p50, s.p95, s.p99, s.max, ss.p50);
+}
+
+// Renders both views for opt->frames frames in each fog mode, panning and zooming the cameras and
+// painting fog every few frames so the incremental fog paths are exercised
+static int bench_run(const BenchOptions *opt) {
+    FILE *out = opt->csv_path ? fopen(opt->csv_path, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Could not write %s\n", opt->csv_path);
+        return 1;
+    }
+    bench_build_scene(opt);
+    static const char *fog_modes[FOG_RENDER_COUNT] = {"runs", "mask", "soft"};
+    static const char *thread_names[PROFILE_THREADS] = {"main", "player"};
+    int cells = BENCH_MAP_SIZE / 64;
+    
+    fprintf(stderr, "Benchmark: %d tokens, %d drawings, %dx%d map, %d frames per fog mode\n",
+            g.token_pool.count, g.drawing_pool.count, BENCH_MAP_SIZE, BENCH_MAP_SIZE, opt->frames);
+    fprintf(out, "fog_mode,thread,zone,frames,p50_ms,p95_ms,p99_ms,max_ms,self_p50_ms\n");
+    for (int mode = 0; mode < FOG_RENDER_COUNT; mode++) {
+        g.fog_render = mode;
+        SDL_LockMutex(profiler.lock);
+        profiler.head = profiler.frames = 0;
+        for (int t = 0; t < PROFILE_THREADS; t++)
+            for (int z = 0; z < PZ_COUNT; z++) profiler.parent[t][z] = PZ_NONE;
+        SDL_UnlockMutex(profiler.lock);
+        
+        for (int f = 0; f < opt->frames; f++) {
+            profile_frame_begin();
+            float k = f * 0.05f;
+            for (int v = 0; v < 2; v++) {
+                Camera *c = &g.cam[v];
+                c->zoom = c->target_zoom = (v == 0 ? 0.75f : 0.5f) + 0.25f * sinf(k * 0.7f);
+                c->x = c->target_x = BENCH_MAP_SIZE / 2 + (BENCH_MAP_SIZE / 3) * sinf(k);
+                c->y = c->target_y = BENCH_MAP_SIZE / 2 + (BENCH_MAP_SIZE / 3) * cosf(k * 0.8f);
+            }
+            if (f % 5 == 0) fog_paint_brush(bench_rand(cells), bench_rand(cells), bench_rand(2), 5);
+            
+            player_render_submit();  // No render thread in bench mode: renders inline
+            Scene dm;
+            dm_scene_capture(&dm);
+            PROFILE_BEGIN(render_dm);
+            render_view(&dm, 0);
+            PROFILE_END(render_dm);
+            profile_frame_end();
+        }
+        
+        SDL_LockMutex(profiler.lock);
+        bench_print_stats(out, fog_modes[mode], "main", "frame", profiler.frame_ms, NULL);
+        int rows[PROFILE_THREADS * PZ_COUNT][2];
+        for (int t = 0; t < PROFILE_THREADS; t++) {
+            int n = profile_zone_rows(t, PZ_NONE, 0, rows, 0);
+            for (int i = 0; i < n; i++) {
+                int z = rows[i][0];
+                bench_print_stats(out, fog_modes[mode], thread_names[t], profile_zone_names[z],
+                                  profiler.total_ms[t][z], profiler.self_ms[t][z]);
+            }
+            for (int k = 0; k < PC_COUNT; k++) {  // Counts per frame rather than milliseconds
+                char name[64];
+                snprintf(name, sizeof(name), "count.%s", profile_counter_names[k]);
+                bench_print_stats(out, fog_modes[mode], thread_names[t], name, profiler.count[t][k], NULL);
+            }
+        }
+        SDL_UnlockMutex(profiler.lock);
+    }
+    if (out != stdout && fclose(out) != 0) {
+        fprintf(stderr, "Could not write %s\n", opt->csv_path);
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char **argv) {
-    (void)argc; (void)argv;
+    bool trace_at_start = false, autosave_on = true, autosave_restore = true;
+    BenchOptions bench = {false, PROFILE_HISTORY, 200, 100, NULL};
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--trace")) trace_at_start = true;
+        else if (!strcmp(argv[i], "--bench")) bench.enabled = true;
+        else if (!strcmp(argv[i], "--bench-frames") && i + 1 < argc) bench.frames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--bench-tokens") && i + 1 < argc) bench.tokens = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--bench-drawings") && i + 1 < argc) bench.drawings = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--bench-csv") && i + 1 < argc) bench.csv_path = argv[++i];
+        else if (!strcmp(argv[i], "--no-autosave")) autosave_on = false;
+        else if (!strcmp(argv[i], "--no-restore")) autosave_restore = false;
+        else if (!strcmp(argv[i], "--pixel-cache-mb") && i + 1 < argc) pixel_cache.cap = (size_t)SDL_max(0, atoi(argv[++i])) << 20;
+        else printf("Unknown option: %s\n", argv[i]);
+    }
+    if (bench.enabled) {
+        if (bench.frames <= 0 || bench.tokens <= 0 || bench.drawings <= 0) {
+            fprintf(stderr, "--bench-frames, --bench-tokens and --bench-drawings take a positive count\n");
+            return 1;
+        }
+        if (bench.frames > PROFILE_HISTORY) {  // Percentiles only see the profiler's history
+            fprintf(stderr, "--bench-frames %d is above the %d frames of profiler history, using %d\n",
+                    bench.frames, PROFILE_HISTORY, PROFILE_HISTORY);
+            bench.frames = PROFILE_HISTORY;
+        }
+    }
+    
+    pool_init(&g.token_pool, sizeof(Token));
+    pool_init(&g.drawing_pool, sizeof(Drawing));
+    g.drag_idx = g.cond_token_idx = -1;
     
+    // Bench mode needs no display: offscreen windows and the software renderer
+    if (bench.enabled) SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
     SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS);
     
     // Initialize profiler
     profiler.freq = SDL_GetPerformanceFrequency();
-    profiler.count = 0;
+    profiler.budget_ms = 1000.0f / 60;
     profiler.show_overlay = false;
+    for (int t = 0; t < PROFILE_THREADS; t++)
+        for (int z = 0; z < PZ_COUNT; z++) profiler.parent[t][z] = PZ_NONE;
+    profiler.thread_ids[0] = SDL_GetCurrentThreadID();
     
     // Initialize touch input state
     g.touch_count = 0;
@@ -2024,15 +5471,25 @@ int main(int argc, char **argv) {
     
     g.dm.win = SDL_CreateWindow("DM View", 1280, 720, SDL_WINDOW_RESIZABLE);
     g.player.win = SDL_CreateWindow("Player View", 1280, 720, SDL_WINDOW_RESIZABLE);
-    g.dm.ren = SDL_CreateRenderer(g.dm.win, NULL);
-    g.player.ren = SDL_CreateRenderer(g.player.win, NULL);
+    g.dm.ren = SDL_CreateRenderer(g.dm.win, bench.enabled ? "software" : NULL);
+    g.player.ren = SDL_CreateRenderer(g.player.win, bench.enabled ? "software" : NULL);
+    if (!g.dm.ren || !g.player.ren) {
+        printf("Could not create renderers: %s\n", SDL_GetError());
+        return 1;
+    }
+    profiler.lock = SDL_CreateMutex();
+    pixel_cache.lock = SDL_CreateMutex();
+    if (trace_at_start) profile_trace_start();
+    player_rt.lock = SDL_CreateMutex();
+    player_rt.go = SDL_CreateSemaphore(0);
+    if (!bench.enabled) player_rt.thread = SDL_CreateThread(player_render_thread, "player_render", NULL);
     g.dm.id = SDL_GetWindowID(g.dm.win);
     g.player.id = SDL_GetWindowID(g.player.win);
     
     // Position player window on secondary monitor if available
     int num_displays = 0;
-    SDL_DisplayID *displays = SDL_GetDisplays(&num_displays);
-    printf("Number of displays detected: %d\n", num_displays);
+    SDL_DisplayID *displays = bench.enabled ? NULL : SDL_GetDisplays(&num_displays);
+    if (displays) printf("Number of displays detected: %d\n", num_displays);
     
     if (displays && num_displays > 1) {
         SDL_DisplayID primary = SDL_GetPrimaryDisplay();
@@ -2138,19 +5595,11 @@ int main(int argc, char **argv) {
         printf("Then compile with: -DEMBED_FONT\n");
     }
     
-    SDL_Color white = {255, 255, 255, 255};
-    const char *cond_abbrev[] = {"BL","DA","FR","GR","RE","SL","TA","WE"};
-    const char *cond_names[] = {"Bleeding","Dazed","Frightened","Grabbed","Restrained","Slowed","Taunted","Weakened"};
-    for (int i = 0; i < COND_COUNT; i++) {
-        g.cond_tex[0][i] = bake_text_once(g.dm.ren, cond_abbrev[i], &g.cond_w, &g.cond_h, white, 16.0f);
-        g.cond_tex[1][i] = bake_text_once(g.player.ren, cond_abbrev[i], &g.cond_w, &g.cond_h, white, 16.0f);
-        int dummy_w, dummy_h;
-        g.cond_wheel_tex[i] = bake_text_once(g.dm.ren, cond_names[i], &dummy_w, &dummy_h, white, 16.0f);
+    if (!bench.enabled) {
+        scan_assets("assets/maps", g.map_assets, &g.map_count);
+        scan_assets("assets/tokens", g.token_lib, &g.token_lib_count);
     }
     
-    scan_assets("assets/maps", g.map_assets, &g.map_count);
-    scan_assets("assets/tokens", g.token_lib, &g.token_lib_count);
-    
     if (g.map_count > 0) {
         // Only load the first map on startup for faster loading
         g.map_current = 0;
@@ -2161,6 +5610,8 @@ int main(int argc, char **argv) {
         g.grid_off_x = g.grid_off_y = 0;
         fog_init((g.map_w+64)/64, (g.map_h+64)/64);
     }
+    asset_workers_start();
+    map_prefetch();
     
     g.cam[0].target_zoom = g.cam[1].target_zoom = 1.0f;
     g.current_squad = 0;
@@ -2172,11 +5623,18 @@ int main(int argc, char **argv) {
     g.cached_cal_drag = false;
     g.cached_measure_dist[0] = g.cached_measure_dist[1] = -1;
     g.fog_brush_size = 1;
+    g.view_dirty[0] = g.view_dirty[1] = true;
+    token_index_rebuild();
+    token_hot_rebuild();
+    
+    if (bench.enabled) return bench_run(&bench);
+    if (autosave_on) autosave_start(autosave_restore);
     
     printf("VTT started. Controls:\n");
     printf("  1 - Select tool, 2 - Fog tool, 3 - Squad assignment tool, 4 - Draw tool\n");
     printf("  Left click - Select/move tokens, toggle fog, assign squad, or draw shapes\n");
     printf("  +/- - Fog tool: adjust brush size | Select tool: resize token\n");
+    printf("  CTRL+Click - Fog tool: flood fill the connected hidden/revealed area\n");
     printf("  Right click - Pan camera (drag) / Delete drawing (middle-click in draw mode)\n");
     printf("  Mouse Wheel - Zoom in/out at cursor\n");
     printf("  Touch: Two-finger pinch - Zoom | Two-finger drag - Pan camera (Steam Deck!)\n");
@@ -2189,9 +5647,11 @@ int main(int argc, char **argv) {
     printf("  X - Clear all drawings (in draw mode)\n");
     printf("  P - Toggle player view sync to DM view\n");
     printf("  G - Toggle grid overlay\n");
+    printf("  V - Cycle fog rendering mode\n");
     printf("  F10 - Zoom to fit map in player window\n");
     printf("  F11 - Toggle fullscreen (for focused window)\n");
-    printf("  F12 - Toggle performance profiler (prints to console)\n");
+    printf("  F12 - Toggle profiler overlay (frame graph and zone percentiles, also printed to console)\n");
+    printf("  SHIFT+F12 - Start/stop trace recording (writes trace_*.json for chrome://tracing; --trace records from launch)\n");
     printf("  M - Cycle to next map, SHIFT+M - Previous map\n");
     printf("  C - Enter grid calibration mode\n");
     printf("      Arrow keys - Move grid | Shift+Arrows - Resize grid | +/- - Adjust cells | Enter - Confirm\n");
@@ -2206,37 +5666,73 @@ int main(int argc, char **argv) {
     printf("  Drag & Drop - Drop image files onto DM window to add tokens\n");
     printf("  SHIFT+F1-F12 - Save to slot\n");
     printf("  F1-F12 - Load from slot\n");
+    if (autosave_on) printf("  Autosave - Changes are journaled to %s and restored on the next start (--no-restore starts fresh)\n", AUTOSAVE_PATH);
     printf("  ESC - Deselect all / Cancel damage input / Close condition wheel\n");
     printf("  X button (on either window) - Close application\n");
     
+    uint64_t next_frame_ns = 0, last_frame_ns = 0;
     while (1) {
+        // Block until input arrives while nothing is changing or easing
+        bool idle = !views_active();
+        if (idle) SDL_WaitEventTimeout(NULL, idle_wait_ms());
+        // While active, keep taking input until the next refresh so the frame shows the latest state.
+        // The waits stay outside the frame; input handled between them counts toward the next one.
+        for (uint64_t now = SDL_GetTicksNS(); now < next_frame_ns; now = SDL_GetTicksNS()) {
+            SDL_WaitEventTimeout(NULL, (int32_t)((next_frame_ns - now + 999999) / 1000000));
+            PROFILE_BEGIN(handle_input);
+            handle_input();
+            PROFILE_END(handle_input);
+        }
+        
         profile_frame_begin();
         
         PROFILE_BEGIN(handle_input);
         handle_input();
         PROFILE_END(handle_input);
+        autosave_tick();
+        uint64_t period_ns = frame_period_ns();
+        uint64_t frame_ns = SDL_GetTicksNS();
+        next_frame_ns = frame_ns + period_ns;
+        profiler.budget_ms = period_ns / 1e6f;
+        // Easing that starts after an idle wait takes one refresh period for its first step
+        float dt_s = (idle || !last_frame_ns ? period_ns : frame_ns - last_frame_ns) / 1e9f;
+        last_frame_ns = frame_ns;
         
         PROFILE_BEGIN(cam_update);
-        cam_update(&g.cam[0]);
+        if (cam_update(&g.cam[0], dt_s)) g.view_dirty[0] = true;
         if (g.sync_views) {
             g.cam[1].target_x = g.cam[0].target_x;
             g.cam[1].target_y = g.cam[0].target_y;
             g.cam[1].target_zoom = g.cam[0].target_zoom;
         }
-        cam_update(&g.cam[1]);
+        if (cam_update(&g.cam[1], dt_s)) g.view_dirty[1] = true;
         PROFILE_END(cam_update);
         
-        PROFILE_BEGIN(render_dm);
-        render_view(0);
-        PROFILE_END(render_dm);
+        if (save_rt.notice_until && SDL_GetTicks() >= save_rt.notice_until) {  // Clear the save result
+            save_rt.notice_until = 0;
+            g.view_dirty[0] = true;
+        }
         
-        PROFILE_BEGIN(render_player);
-        render_view(1);
-        PROFILE_END(render_player);
+        // Views whose state and camera have settled keep their last presented frame. The player
+        // frame is handed off first so both presents overlap; if its thread is still busy the
+        // view stays dirty and goes out next frame with the newer state.
+        if (g.view_dirty[1] && player_render_submit()) g.view_dirty[1] = false;
         
-        profile_frame_end();
+        if (g.view_dirty[0]) {
+            g.view_dirty[0] = false;
+            Scene dm;
+            dm_scene_capture(&dm);
+            PROFILE_BEGIN(render_dm);
+            render_view(&dm, 0);
+            PROFILE_END(render_dm);
+        }
+        
+        if (g.input_ns) {
+            profile_record_ns(PZ_input_to_present, SDL_GetTicksNS() - g.input_ns);
+            g.input_ns = 0;
+        }
         
-        SDL_Delay(16);
+        profile_frame_end();
     }
     
     return 0;